@@ -0,0 +1,115 @@
+-- Interpreter loops dominated by one group of opcodes each, to compare
+-- the dispatch modes of 'luaV_execute'. Build two interpreters,
+--   make linux MYCFLAGS=-DLUA_USE_JUMPTABLE=1   (label table)
+--   make linux MYCFLAGS=-DLUA_USE_JUMPTABLE=0   (plain 'switch')
+-- (doing 'make clean' between them) and run this script with both.
+-- Usage: lua dispatch.lua [scale]   (default 1)
+-- Each line shows the time and a result, which must not change between
+-- builds.
+
+local S = tonumber(arg and arg[1]) or 1
+local N = 10000000 * S
+
+local function time (name, f)
+  local t = os.clock()
+  local r = f()
+  print(string.format("%-30s %.3f s  (%s)", name, os.clock() - t,
+                      tostring(r)))
+end
+
+time("MOVE/LOADK/FORLOOP", function ()
+  local a, b, c = 0, 0, 0
+  for i = 1, N do a = i; b = a; c = 7; a = c end
+  return a + b
+end)
+
+time("ADD/SUB/MUL integer", function ()
+  local s = 0
+  for i = 1, N do s = s + i * 3 - (i - 1) end
+  return s
+end)
+
+time("ADD/MUL/DIV float", function ()
+  local s = 0.0
+  for i = 1, N do s = s * 0.5 + i / 3 end
+  return s
+end)
+
+time("MOD/IDIV/BAND/SHL", function ()
+  local s = 0
+  for i = 1, N do s = s + (i % 7) + (i // 5) + (i & 0xff) + (i << 1) end
+  return s
+end)
+
+time("EQ/LT/LE/TEST/JMP", function ()
+  local n = 0
+  for i = 1, N do
+    if i < 100 then n = n + 1 elseif i <= 200 then n = n + 2 end
+    if i == 300 or not (i ~= 400) then n = n + 3 end
+  end
+  return n
+end)
+
+time("GETTABLE/SETTABLE (array)", function ()
+  local t = {}
+  for i = 1, 100 do t[i] = i end
+  for i = 1, N do local k = i % 100 + 1; t[k] = t[k] + 1 end
+  return t[1]
+end)
+
+time("GETTABLE/SETTABLE (fields)", function ()
+  local o = {x = 1, y = 2, z = 3}
+  for i = 1, N do o.x = o.y + o.z; o.y = o.x - o.z end
+  return o.x
+end)
+
+time("GETUPVAL/SETUPVAL", function ()
+  local u = 0
+  local function f ()
+    for i = 1, N do u = u + 1 end
+  end
+  f()
+  return u
+end)
+
+time("GETTABUP (globals)", function ()
+  local n = 0
+  for i = 1, N // 2 do if type(n) then n = n + 1 end end
+  return n
+end)
+
+time("CALL/RETURN", function ()
+  local function f (a, b) return a + b end
+  local s = 0
+  for i = 1, N // 2 do s = f(s, i) end
+  return s
+end)
+
+time("SELF (method calls)", function ()
+  local obj = {n = 0}
+  function obj:inc (d) self.n = self.n + d end
+  for i = 1, N // 2 do obj:inc(1) end
+  return obj.n
+end)
+
+time("CLOSURE", function ()
+  local f
+  for i = 1, N // 10 do f = function () return i end end
+  return f()
+end)
+
+time("CONCAT/LEN", function ()
+  local n = 0
+  for i = 1, N // 10 do n = n + #("k" .. (i & 7)) end
+  return n
+end)
+
+time("TFORCALL/TFORLOOP (ipairs)", function ()
+  local t = {}
+  for i = 1, 1000 do t[i] = i end
+  local s = 0
+  for r = 1, N // 1000 do
+    for _, v in ipairs(t) do s = s + v end
+  end
+  return s
+end)
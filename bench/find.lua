@@ -0,0 +1,72 @@
+-- Plain searches (string.find with 'plain' set) over a log file.
+-- Usage: lua find.lua logfile
+-- (lua logcorpus.lua log.txt creates the log of the numbers in the
+-- commit that added the search; any other log works too.)
+-- Each line shows the time and a count, which must not change between
+-- versions.
+
+local fname = assert(arg and arg[1], "usage: lua find.lua logfile")
+local f = assert(io.open(fname, "rb"))
+local log = f:read("a")
+f:close()
+local lines = {}
+for l in log:gmatch("[^\n]+") do lines[#lines + 1] = l end
+
+local function count (s, p)
+  local n, i = 0, 1
+  while true do
+    local a, b = s:find(p, i, true)
+    if not a then return n end
+    n = n + 1
+    i = b + 1
+  end
+end
+
+local function time (name, f)
+  local t = os.clock()
+  local r = f()
+  print(string.format("%-34s %.3f s  (%s)", name, os.clock() - t, tostring(r)))
+end
+
+print(string.format("%d lines, %.1f MB", #lines, #log / 2^20))
+
+time("per-line find \"status=500\"", function ()
+  local n = 0
+  for r = 1, 10 do
+    for i = 1, #lines do
+      if lines[i]:find("status=500", 1, true) then n = n + 1 end
+    end
+  end
+  return n
+end)
+
+time("count \"/items/49999?\"", function ()
+  local n = 0
+  for r = 1, 20 do n = n + count(log, "/items/49999?") end
+  return n
+end)
+
+time("count \"[ERROR]\"", function ()
+  local n = 0
+  for r = 1, 5 do n = n + count(log, "[ERROR]") end
+  return n
+end)
+
+time("count \"2024-03-29\"", function ()
+  local n = 0
+  for r = 1, 20 do n = n + count(log, "2024-03-29") end
+  return n
+end)
+
+time("gmatch \"user=u96%D\"", function ()
+  local n = 0
+  for r = 1, 10 do
+    for _ in log:gmatch("user=u96%D") do n = n + 1 end
+  end
+  return n
+end)
+
+time("\"a\"*5000..\"b\" in 1MB of \"a\"", function ()
+  local s = string.rep("a", 1000000)
+  return s:find(string.rep("a", 5000) .. "b", 1, true)
+end)
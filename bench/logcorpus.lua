@@ -0,0 +1,15 @@
+-- Writes a synthetic web-server log, for the search benchmarks.
+-- Usage: lua logcorpus.lua file [n]   (n lines; default 50000)
+
+local fname = assert(arg and arg[1], "usage: lua logcorpus.lua file [n]")
+local N = tonumber(arg[2]) or 50000
+
+local levels = {"INFO", "WARN", "ERROR", "DEBUG"}
+local f = assert(io.open(fname, "w"))
+for i = 1, N do
+  f:write(string.format(
+    "2024-03-%02d %02d:%02d:%02d [%s] GET /api/v1/items/%d?user=u%d took %dms status=%d\n",
+    i % 28 + 1, i % 24, i % 60, (i * 7) % 60, levels[i % 4 + 1], i, i % 97,
+    i % 500, (i % 10 == 0) and 500 or 200))
+end
+f:close()
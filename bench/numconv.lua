@@ -0,0 +1,29 @@
+-- Number-to-string conversions (tostring and '..' coercions).
+-- Usage: lua numconv.lua [n]   (n conversions per test; default 1M)
+-- test/numconv.lua checks that the output stays the same.
+
+local N = tonumber(arg and arg[1]) or 1000000
+
+local function time (name, f)
+  local t = os.clock()
+  f()
+  print(string.format("%-38s %.3f s", name, os.clock() - t))
+end
+
+time("tostring(i * 0.37)", function ()
+  for i = 1, N do local s = tostring(i * 0.37) end
+end)
+
+time("tostring(i * 1234567)", function ()
+  for i = 1, N do local s = tostring(i * 1234567) end
+end)
+
+time("i .. \",\" .. i / 7 .. \",\" .. i * 1.5", function ()
+  for i = 1, N do local s = i .. "," .. i / 7 .. "," .. i * 1.5 end
+end)
+
+time("table.concat of i / 3", function ()
+  local t = {}
+  for i = 1, N do t[i] = i / 3 end
+  return table.concat(t, ",")
+end)
@@ -0,0 +1,79 @@
+-- Pattern matching on log lines (string.find/match/gmatch/gsub).
+-- Usage: lua patterns.lua [n]   (n log lines; default 20000)
+-- Each line shows the time and a result, which must not change
+-- between versions.
+
+local N = tonumber(arg and arg[1]) or 20000
+
+local levels = {"INFO", "WARN", "ERROR", "DEBUG"}
+local lines = {}
+for i = 1, N do
+  lines[i] = string.format(
+    "2024-03-%02d %02d:%02d:%02d [%s] GET /api/v1/items/%d?user=u%d took %dms status=%d",
+    i % 28 + 1, i % 24, i % 60, (i * 7) % 60, levels[i % 4 + 1], i, i % 97,
+    i % 500, (i % 10 == 0) and 500 or 200)
+end
+local log = table.concat(lines, "\n")
+
+local function time (name, f)
+  local t = os.clock()
+  local r = f()
+  print(string.format("%-34s %.3f s  (%s)", name, os.clock() - t, tostring(r)))
+end
+
+time("match with 6 captures, anchored", function ()
+  local n = 0
+  for r = 1, 5 do
+    for i = 1, N do
+      local y, mo, d, lv, path, ms = lines[i]:match(
+        "^(%d+)-(%d+)-(%d+) %d+:%d+:%d+ %[(%u+)%] %u+ (%S+) took (%d+)ms")
+      if lv == "ERROR" then n = n + tonumber(ms) end
+    end
+  end
+  return n
+end)
+
+time("find \"status=5%d%d\"", function ()
+  local n = 0
+  for r = 1, 10 do
+    for i = 1, N do
+      if lines[i]:find("status=5%d%d") then n = n + 1 end
+    end
+  end
+  return n
+end)
+
+time("gmatch \"took (%d+)ms\"", function ()
+  local n = 0
+  for r = 1, 3 do
+    for ms in log:gmatch("took (%d+)ms") do n = n + #ms end
+  end
+  return n
+end)
+
+time("gmatch \"%a+\"", function ()
+  local n = 0
+  for w in log:gmatch("%a+") do n = n + 1 end
+  return n
+end)
+
+time("gsub \"user=u%d+\"", function ()
+  local s, k
+  for r = 1, 3 do s, k = log:gsub("user=u%d+", "user=?") end
+  return k
+end)
+
+time("gsub with function", function ()
+  local s, k = log:gsub("%[(%u+)%]", function (l) return l:lower() end)
+  return k
+end)
+
+time("1M tiny match/find calls", function ()
+  local n = 0
+  for i = 1, 1000000 do
+    local s = "k12"
+    if s:match("^k(%d+)$") then n = n + 1 end
+    if s:find("%d") then n = n + 1 end
+  end
+  return n
+end)
@@ -0,0 +1,97 @@
+/*
+** Collision counts and speed of the string hash 'luaS_hash', compared
+** with the hash of Lua 5.3 (which skips bytes of strings of 32 bytes
+** or more). Build it against the library objects:
+**   cc -O2 -I../src strhash.c ../src/liblua.a -lm -o strhash
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+
+#include "lobject.h"
+#include "lstring.h"
+
+
+#define NKEYS		100000
+#define NBUCKETS	(1 << 17)
+#define NHASHES		20000000
+
+
+typedef unsigned int (*Hashf) (const char *str, size_t l, unsigned int seed);
+
+
+/* the hash of Lua 5.3 */
+static unsigned int oldhash (const char *str, size_t l, unsigned int seed) {
+  unsigned int h = seed ^ (unsigned int)l;
+  size_t step = (l >> 5) + 1;
+  for (; l >= step; l -= step)
+    h ^= ((h<<5) + (h>>2) + (unsigned char)str[l - 1]);
+  return h;
+}
+
+
+/*
+** Counts the keys that fall into an already used bucket. A random
+** function gives about 30000 for 100000 keys in 2^17 buckets.
+*/
+static int collisions (Hashf f, const char *fmt) {
+  unsigned char *used = (unsigned char *)calloc(NBUCKETS, 1);
+  char s[256];
+  int i, coll = 0;
+  for (i = 0; i < NKEYS; i++) {
+    int l = snprintf(s, sizeof(s), fmt, i);
+    unsigned int h = f(s, (size_t)l, 12345);
+    if (used[h & (NBUCKETS - 1)]++) coll++;
+  }
+  free(used);
+  return coll;
+}
+
+
+/* millions of hashes per second of keys shaped like 'fmt' */
+static double speed (Hashf f, const char *fmt) {
+  char s[256];
+  unsigned int acc = 0;
+  int r;
+  int l = snprintf(s, sizeof(s), fmt, 7);
+  clock_t c0 = clock();
+  for (r = 0; r < NHASHES; r++) {
+    s[l - 1] = (char)r;  /* keep the compiler from hoisting the call */
+    acc += f(s, (size_t)l, (unsigned int)r);
+  }
+  if (acc == 1) printf(" ");  /* use 'acc' */
+  return (NHASHES / 1e6) / ((double)(clock() - c0) / CLOCKS_PER_SEC);
+}
+
+
+static const struct {
+  const char *name;
+  const char *fmt;
+} keys[] = {
+  {"short", "k%d"},
+  {"field", "user_%d_name"},
+  {"path", "/api/v1/organizations/projects/%08d/settings"},
+  {"json", "{\"type\":\"event\",\"payload\":{\"id\":%09d,"
+           "\"source\":\"sensor-array-north\"}}"},
+  {NULL, NULL}
+};
+
+
+int main (void) {
+  int i;
+  printf("%-12s %5s  %17s  %19s\n", "", "bytes",
+         "collisions 5.3/new", "Mhash/s 5.3/new");
+  for (i = 0; keys[i].name != NULL; i++) {
+    const char *fmt = keys[i].fmt;
+    char s[256];
+    printf("%-12s %5d  %8d %8d  %9.0f %9.0f\n", keys[i].name,
+           snprintf(s, sizeof(s), fmt, 7),
+           collisions(oldhash, fmt), collisions(luaS_hash, fmt),
+           speed(oldhash, fmt), speed(luaS_hash, fmt));
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+-- String interning and string keys, as seen from Lua.
+-- Usage: lua strintern.lua [n]   (n path keys; default 100000)
+
+local N = tonumber(arg and arg[1]) or 100000
+
+local function time (name, f)
+  local t = os.clock()
+  f()
+  print(string.format("%-24s %.3f s", name, os.clock() - t))
+end
+
+time("intern 2M short strings", function ()
+  local s
+  for i = 1, 2000000 do s = "k" .. (i % 50000) end
+  return s
+end)
+
+local keys = {}
+for i = 1, N do
+  keys[i] = string.format("/api/v1/organizations/projects/%08d/settings", i)
+end
+
+local t
+time("insert path keys", function ()
+  t = {}
+  for i = 1, N do t[keys[i]] = i end
+end)
+
+time("look up path keys", function ()
+  local s = 0
+  for i = 1, N do s = s + t[keys[i]] end
+  assert(s == N * (N + 1) // 2)
+end)
@@ -0,0 +1,108 @@
+-- Insertions, lookups and traversals in the hash part of tables, to
+-- compare the chained layout with open addressing. Build two
+-- interpreters,
+--   make linux                                 (chained)
+--   make linux MYCFLAGS=-DLUA_USE_GROUPHASH    (open addressing)
+-- (doing 'make clean' between them) and run this script with both.
+-- Usage: lua tables.lua [n]   (n keys; default 700000)
+-- Each line shows the time and a result, which must not change between
+-- builds.
+
+local N = tonumber(arg and arg[1]) or 700000
+
+local function time (name, f)
+  local t = os.clock()
+  local r = f()
+  print(string.format("%-28s %.3f s  (%s)", name, os.clock() - t,
+                      tostring(r)))
+end
+
+local skeys = {}
+for i = 1, N do skeys[i] = "key" .. (i * 7919) end
+
+local t
+time("insert string keys", function ()
+  t = {}
+  for i = 1, N do t[skeys[i]] = i end
+  return #skeys
+end)
+
+time("look up string keys (x3)", function ()
+  local s = 0
+  for r = 1, 3 do
+    for i = 1, N do s = s + t[skeys[i]] end
+  end
+  return s
+end)
+
+time("look up missing strings", function ()
+  local s = 0
+  for i = 1, N do
+    if t["nokey" .. (i % 1000)] then s = s + 1 end
+  end
+  return s
+end)
+
+time("traverse (x3)", function ()
+  local s = 0
+  for r = 1, 3 do
+    for k, v in pairs(t) do s = s + v end
+  end
+  return s
+end)
+
+-- integer keys scattered over the whole range, looked up in random order
+local ikeys = {}
+for i = 1, N do ikeys[i] = (i * 0x9E3779B97F4A7C15) >> 24 end
+time("insert random integers", function ()
+  t = {}
+  for i = 1, N do t[ikeys[i]] = i end
+  return N
+end)
+math.randomseed(42)
+for i = N, 2, -1 do
+  local j = math.random(i)
+  ikeys[i], ikeys[j] = ikeys[j], ikeys[i]
+end
+time("look up random integers (x3)", function ()
+  local s = 0
+  for r = 1, 3 do
+    for i = 1, N do s = s + t[ikeys[i]] end
+  end
+  return s
+end)
+
+time("insert float keys", function ()
+  t = {}
+  for i = 1, N do t[i + 0.5] = i end
+  return N
+end)
+
+time("look up float keys (x3)", function ()
+  local s = 0
+  for r = 1, 3 do
+    for i = 1, N do s = s + t[i + 0.5] end
+  end
+  return s
+end)
+
+-- integers with equal low bits, which collide in the chained layout
+time("100k multiples of 512", function ()
+  t = {}
+  for i = 1, 100000 do t[i * 512] = i end
+  local s = 0
+  for r = 1, 3 do
+    for i = 1, 100000 do s = s + t[i * 512] end
+  end
+  return s
+end)
+
+time("table keys", function ()
+  local objs = {}
+  for i = 1, 1000 do objs[i] = {} end
+  t = {}
+  for r = 1, 300 do
+    for i = 1, 1000 do t[objs[i]] = r end
+  end
+  return t[objs[1]]
+end)
@@ -20,6 +20,7 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -392,6 +393,11 @@ LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
     o = index2addr(L, idx);  /* previous call may reallocate the stack */
     lua_unlock(L);
   }
+  else if (ttislngstring(o) && isbufstr(tsvalue(o))) {
+    lua_lock(L);  /* 'luaS_flatten' may create a new buffer */
+    luaS_flatten(L, tsvalue(o), 1);  /* C code will keep its bytes */
+    lua_unlock(L);
+  }
   if (len != NULL)
     *len = vslen(o);
   return svalue(o);
@@ -497,6 +503,29 @@ LUA_API const char *lua_pushlstring (lua_State *L, const char *s, size_t len) {
 }
 
 
+/*
+** Pushes a string using the 'len' bytes at 's' (which must be followed
+** by a '\0') without copying them. They must stay valid and unchanged
+** until Lua releases them by calling 'falloc(ud, s, len + 1, 0)' (if
+** 'falloc' is not NULL), which may happen right away: short strings
+** must be internalized, so they are copied. Lua owns the bytes from the
+** call on; if the push raises an error, they are released before it
+** propagates.
+*/
+LUA_API const char *lua_pushexternalstring (lua_State *L, const char *s,
+                                   size_t len, lua_Alloc falloc, void *ud) {
+  TString *ts;
+  lua_lock(L);
+  api_check(L, s[len] == '\0', "string not ending with zero");
+  ts = luaS_newext(L, s, len, falloc, ud);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return getstr(ts);
+}
+
+
 LUA_API const char *lua_pushstring (lua_State *L, const char *s) {
   lua_lock(L);
   if (s == NULL)
@@ -703,6 +732,21 @@ LUA_API void lua_createtable (lua_State *L, int narray, int nrec) {
 }
 
 
+LUA_API void lua_clonetable (lua_State *L, int idx) {
+  const TValue *o;
+  Table *t;
+  lua_lock(L);
+  o = index2addr(L, idx);
+  api_check(L, ttistable(o), "table expected");
+  t = luaH_new(L);
+  sethvalue(L, L->top, t);
+  api_incr_top(L);
+  luaH_copy(L, t, hvalue(o));
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_getmetatable (lua_State *L, int objindex) {
   const TValue *obj;
   Table *mt;
@@ -809,13 +853,16 @@ LUA_API void lua_seti (lua_State *L, int idx, lua_Integer n) {
 
 LUA_API void lua_rawset (lua_State *L, int idx) {
   StkId o;
-  TValue *slot;
+  const TValue *slot;
   lua_lock(L);
   api_checknelems(L, 2);
   o = index2addr(L, idx);
   api_check(L, ttistable(o), "table expected");
-  slot = luaH_set(L, hvalue(o), L->top - 2);
-  setobj2t(L, slot, L->top - 1);
+  slot = luaH_get(hvalue(o), L->top - 2);
+  if (ttisnil(slot) || luaH_isbox(hvalue(o), slot) || isfrozen(hvalue(o)))
+    luaH_finishset(L, hvalue(o), L->top - 2, slot, L->top - 1);
+  else
+    setobj2t(L, cast(TValue *, slot), L->top - 1);
   invalidateTMcache(hvalue(o));
   luaC_barrierback(L, hvalue(o), L->top-1);
   L->top -= 2;
@@ -866,6 +913,8 @@ LUA_API int lua_setmetatable (lua_State *L, int objindex) {
   }
   switch (ttnov(obj)) {
     case LUA_TTABLE: {
+      if (isfrozen(hvalue(obj)))
+        luaG_runerror(L, "attempt to modify a frozen table");
       hvalue(obj)->metatable = mt;
       if (mt) {
         luaC_objbarrier(L, gcvalue(obj), mt);
@@ -1130,6 +1179,56 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
 }
 
 
+/*
+** Native-compiler function
+*/
+
+LUA_API int lua_jit (lua_State *L, int what, int data) {
+  int res = 0;
+#if defined(LUA_USE_JIT)
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  switch (what) {
+    case LUA_JITOFF: {
+      g->jiton = 0;
+      break;
+    }
+    case LUA_JITON: {
+      g->jiton = 1;
+      break;
+    }
+    case LUA_JITISON: {
+      res = g->jiton;
+      break;
+    }
+    case LUA_JITSETTHRESHOLD: {
+      res = g->jitthreshold;
+      if (data < 1) data = 1;  /* 0 would never compile anything */
+      g->jitthreshold = data;
+      break;
+    }
+    case LUA_JITCOMPILE: {  /* compile function at index 'data' now */
+      StkId o = index2addr(L, data);
+      if (ttisLclosure(o)) {
+        Proto *p = clLvalue(o)->p;
+        if (p->jit == NULL && p->jithot > 0)  /* not tried yet? */
+          luaJ_compile(L, p);
+        res = (p->jit != NULL);
+      }
+      break;
+    }
+    default: res = -1;  /* invalid option */
+  }
+  lua_unlock(L);
+#else
+  UNUSED(L); UNUSED(what); UNUSED(data);
+  res = -1;  /* no compiler */
+#endif
+  return res;
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -1188,6 +1287,43 @@ LUA_API void lua_len (lua_State *L, int idx) {
 }
 
 
+LUA_API void lua_freezetable (lua_State *L, int idx) {
+  StkId t;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  luaH_freeze(L, hvalue(t));
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
+LUA_API int lua_isfrozen (lua_State *L, int idx) {
+  const TValue *o = index2addr(L, idx);
+  return ttistable(o) && isfrozen(hvalue(o));
+}
+
+
+LUA_API void lua_tablestats (lua_State *L, int idx, unsigned int *stats) {
+  StkId t;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  luaH_stats(hvalue(t), stats);
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_cleartable (lua_State *L, int idx) {
+  StkId t;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  luaH_clear(L, hvalue(t));
+  lua_unlock(L);
+}
+
+
 LUA_API lua_Alloc lua_getallocf (lua_State *L, void **ud) {
   lua_Alloc f;
   lua_lock(L);
@@ -55,6 +55,16 @@ static int tonumeral(const expdesc *e, TValue *v) {
 }
 
 
+/*
+** Check whether expression 'e' is an integer constant that fits in
+** an 'sC' argument (and so can be used as an immediate operand).
+*/
+static int isSCint (const expdesc *e) {
+  return (e->k == VKINT && !hasjumps(e) &&
+          -MAXARG_sC <= e->u.ival && e->u.ival <= MAXARG_sC);
+}
+
+
 /*
 ** Create a OP_LOADNIL instruction, but try to optimize: if the previous
 ** instruction is also OP_LOADNIL and ranges are compatible, adjust
@@ -566,16 +576,28 @@ void luaK_dischargevars (FuncState *fs, expdesc *e) {
     }
     case VINDEXED: {
       OpCode op;
-      freereg(fs, e->u.ind.idx);
+      int idx = e->u.ind.idx;
+      freereg(fs, idx);
       if (e->u.ind.vt == VLOCAL) {  /* is 't' in a register? */
         freereg(fs, e->u.ind.t);
         op = OP_GETTABLE;
+        if (ISK(idx)) {  /* constant key? try specialized opcodes */
+          TValue *key = &fs->f->k[INDEXK(idx)];
+          if (ttisshrstring(key)) {
+            op = OP_GETFIELD;
+            idx = INDEXK(idx);
+          }
+          else if (ttisinteger(key) && l_castS2U(ivalue(key)) <= MAXARG_C) {
+            op = OP_GETI;
+            idx = cast_int(ivalue(key));
+          }
+        }
       }
       else {
         lua_assert(e->u.ind.vt == VUPVAL);
         op = OP_GETTABUP;  /* 't' is in an upvalue */
       }
-      e->u.info = luaK_codeABC(fs, op, 0, e->u.ind.t, e->u.ind.idx);
+      e->u.info = luaK_codeABC(fs, op, 0, e->u.ind.t, idx);
       e->k = VRELOCABLE;
       break;
     }
@@ -826,7 +848,7 @@ static void negatecondition (FuncState *fs, expdesc *e) {
   Instruction *pc = getjumpcontrol(fs, e->u.info);
   lua_assert(testTMode(GET_OPCODE(*pc)) && GET_OPCODE(*pc) != OP_TESTSET &&
                                            GET_OPCODE(*pc) != OP_TEST);
-  SETARG_A(*pc, !(GETARG_A(*pc)));
+  SETARG_A(*pc, GETARG_A(*pc) ^ 1);  /* keep BITIMMFIRST */
 }
 
 
@@ -1021,23 +1043,68 @@ static void codeunexpval (FuncState *fs, OpCode op, expdesc *e, int line) {
 */
 static void codebinexpval (FuncState *fs, OpCode op,
                            expdesc *e1, expdesc *e2, int line) {
-  int rk2 = luaK_exp2RK(fs, e2);  /* both operands are "RK" */
-  int rk1 = luaK_exp2RK(fs, e1);
-  freeexps(fs, e1, e2);
-  e1->u.info = luaK_codeABC(fs, op, 0, rk1, rk2);  /* generate opcode */
+  if ((op == OP_ADD || op == OP_SUB) && e1->k == VNONRELOC && isSCint(e2)) {
+    /* 'R + sC' or 'R - sC': use an immediate operand */
+    int r1 = e1->u.info;
+    freeexp(fs, e1);
+    op = (op == OP_ADD) ? OP_ADDI : OP_SUBI;
+    e1->u.info = luaK_codeABC(fs, op, 0, r1, int2sC(cast_int(e2->u.ival)));
+  }
+  else {
+    int rk2 = luaK_exp2RK(fs, e2);  /* both operands are "RK" */
+    int rk1 = luaK_exp2RK(fs, e1);
+    freeexps(fs, e1, e2);
+    e1->u.info = luaK_codeABC(fs, op, 0, rk1, rk2);  /* generate opcode */
+  }
   e1->k = VRELOCABLE;  /* all those operations are relocatable */
   luaK_fixline(fs, line);
 }
 
 
+/*
+** Emit code for a comparison between register 'e1' and an integer
+** immediate 'e2'.
+*/
+static void codecompimm (FuncState *fs, BinOpr opr, expdesc *e1,
+                                                    expdesc *e2) {
+  int r1 = e1->u.info;
+  int imm = int2sC(cast_int(e2->u.ival));
+  freeexp(fs, e1);
+  switch (opr) {
+    case OPR_EQ: case OPR_NE: {  /* '(a ~= b)' ==> 'not (a == b)' */
+      e1->u.info = condjump(fs, OP_EQI, (opr == OPR_EQ), r1, imm);
+      break;
+    }
+    case OPR_LT: case OPR_LE: {
+      OpCode op = (opr == OPR_LT) ? OP_LTI : OP_LEI;
+      e1->u.info = condjump(fs, op, 1, r1, imm);
+      break;
+    }
+    case OPR_GT: case OPR_GE: {
+      /* '(a > b)' ==> '(b < a)';  '(a >= b)' ==> '(b <= a)' */
+      OpCode op = (opr == OPR_GT) ? OP_LTI : OP_LEI;
+      e1->u.info = condjump(fs, op, 1 | BITIMMFIRST, r1, imm);
+      break;
+    }
+    default: lua_assert(0);
+  }
+  e1->k = VJMP;
+}
+
+
 /*
 ** Emit code for comparisons.
 ** 'e1' was already put in R/K form by 'luaK_infix'.
 */
 static void codecomp (FuncState *fs, BinOpr opr, expdesc *e1, expdesc *e2) {
-  int rk1 = (e1->k == VK) ? RKASK(e1->u.info)
-                          : check_exp(e1->k == VNONRELOC, e1->u.info);
-  int rk2 = luaK_exp2RK(fs, e2);
+  int rk1, rk2;
+  if (e1->k == VNONRELOC && isSCint(e2)) {
+    codecompimm(fs, opr, e1, e2);
+    return;
+  }
+  rk1 = (e1->k == VK) ? RKASK(e1->u.info)
+                      : check_exp(e1->k == VNONRELOC, e1->u.info);
+  rk2 = luaK_exp2RK(fs, e2);
   freeexps(fs, e1, e2);
   switch (opr) {
     case OPR_NE: {  /* '(a ~= b)' ==> 'not (a == b)' */
@@ -1201,3 +1268,22 @@ void luaK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+/*
+** Final pass over the code of a function: fuse frequent pairs of
+** instructions into superinstructions. (Comparisons and tests need no
+** fusion: the interpreter already executes the jump that follows them
+** without dispatching it; see 'donextjump'.)
+*/
+void luaK_finish (FuncState *fs) {
+  Instruction *code = fs->f->code;
+  int pc;
+  for (pc = 0; pc + 1 < fs->pc; pc++) {
+    Instruction i = code[pc];
+    Instruction next = code[pc + 1];
+    if (GET_OPCODE(i) == OP_SELF && GET_OPCODE(next) == OP_CALL &&
+        GETARG_A(next) == GETARG_A(i))  /* method call without arguments? */
+      SET_OPCODE(code[pc], OP_SELFCALL);
+  }
+}
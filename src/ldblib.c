@@ -44,6 +44,21 @@ static int db_getregistry (lua_State *L) {
 }
 
 
+/*
+** returns the size of the array part of a table, the size of its hash
+** part, and the numbers of live and of dead entries in the latter
+*/
+static int db_tablestats (lua_State *L) {
+  unsigned int stats[4];
+  int i;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_tablestats(L, 1, stats);
+  for (i = 0; i < 4; i++)
+    lua_pushinteger(L, stats[i]);
+  return 4;
+}
+
+
 static int db_getmetatable (lua_State *L) {
   luaL_checkany(L, 1);
   if (!lua_getmetatable(L, 1)) {
@@ -444,6 +459,7 @@ static const luaL_Reg dblib[] = {
   {"setlocal", db_setlocal},
   {"setmetatable", db_setmetatable},
   {"setupvalue", db_setupvalue},
+  {"tablestats", db_tablestats},
   {"traceback", db_traceback},
   {NULL, NULL}
 };
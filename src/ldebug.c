@@ -456,6 +456,16 @@ static const char *getobjname (Proto *p, int lastpc, int reg,
         kname(p, pc, k, name);
         return (vn && strcmp(vn, LUA_ENV) == 0) ? "global" : "field";
       }
+      case OP_GETFIELD: {
+        int t = GETARG_B(i);  /* table index */
+        const char *vn = luaF_getlocalname(p, t + 1, pc);
+        kname(p, pc, RKASK(GETARG_C(i)), name);
+        return (vn && strcmp(vn, LUA_ENV) == 0) ? "global" : "field";
+      }
+      case OP_GETI: {
+        *name = "integer index";
+        return "field";
+      }
       case OP_GETUPVAL: {
         *name = upvalname(p, GETARG_B(i));
         return "upvalue";
@@ -470,7 +480,7 @@ static const char *getobjname (Proto *p, int lastpc, int reg,
         }
         break;
       }
-      case OP_SELF: {
+      case OP_SELF: case OP_SELFCALL: {
         int k = GETARG_C(i);  /* key index */
         kname(p, pc, k, name);
         return "method";
@@ -493,7 +503,7 @@ static const char *funcnamefromcode (lua_State *L, CallInfo *ci,
   TMS tm = (TMS)0;  /* (initial value avoids warnings) */
   Proto *p = ci_func(ci)->p;  /* calling function */
   int pc = currentpc(ci);  /* calling instruction index */
-  Instruction i = p->code[pc];  /* calling instruction */
+  Instruction i = luaP_genericinst(p->code[pc]);  /* calling instruction */
   if (ci->callstatus & CIST_HOOKED) {  /* was it called inside a hook? */
     *name = "?";
     return "hook";
@@ -507,7 +517,8 @@ static const char *funcnamefromcode (lua_State *L, CallInfo *ci,
        return "for iterator";
     }
     /* other instructions can do calls through metamethods */
-    case OP_SELF: case OP_GETTABUP: case OP_GETTABLE:
+    case OP_SELF: case OP_SELFCALL: case OP_GETTABUP: case OP_GETTABLE:
+    case OP_GETI: case OP_GETFIELD:
       tm = TM_INDEX;
       break;
     case OP_SETTABUP: case OP_SETTABLE:
@@ -520,17 +531,19 @@ static const char *funcnamefromcode (lua_State *L, CallInfo *ci,
       tm = cast(TMS, offset + cast_int(TM_ADD));  /* ORDER TM */
       break;
     }
+    case OP_ADDI: tm = TM_ADD; break;
+    case OP_SUBI: tm = TM_SUB; break;
     case OP_UNM: tm = TM_UNM; break;
     case OP_BNOT: tm = TM_BNOT; break;
     case OP_LEN: tm = TM_LEN; break;
     case OP_CONCAT: tm = TM_CONCAT; break;
     case OP_EQ: tm = TM_EQ; break;
-    case OP_LT: tm = TM_LT; break;
-    case OP_LE: tm = TM_LE; break;
+    case OP_LT: case OP_LTI: tm = TM_LT; break;
+    case OP_LE: case OP_LEI: tm = TM_LE; break;
     default:
       return NULL;  /* cannot find a reasonable name */
   }
-  *name = getstr(G(L)->tmname[tm]);
+  *name = getshrstr(G(L)->tmname[tm]);
   return "metamethod";
 }
 
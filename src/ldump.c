@@ -15,6 +15,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -88,8 +89,12 @@ static void DumpString (const TString *s, DumpState *D) {
 
 
 static void DumpCode (const Proto *f, DumpState *D) {
+  int i;
   DumpInt(f->sizecode, D);
-  DumpVector(f->code, f->sizecode, D);
+  for (i = 0; i < f->sizecode; i++) {
+    Instruction inst = luaP_genericinst(f->code[i]);
+    DumpVector(&inst, 1, D);
+  }
 }
 
 
@@ -16,6 +16,7 @@
 
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -126,6 +127,10 @@ Proto *luaF_newproto (lua_State *L) {
   f->maxstacksize = 0;
   f->locvars = NULL;
   f->sizelocvars = 0;
+  f->icache = NULL;
+  f->sizeicache = 0;
+  f->jit = NULL;
+  f->jithot = G(L)->jitthreshold;
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
@@ -140,10 +145,28 @@ void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->lineinfo, f->sizelineinfo);
   luaM_freearray(L, f->locvars, f->sizelocvars);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
+  luaM_freearray(L, f->icache, f->sizeicache);
+  luaJ_free(L, f);
   luaM_free(L, f);
 }
 
 
+/*
+** Create the inline caches of a prototype whose code is already in
+** place, one per instruction, all starting at 0. Table reads keep
+** there a slot hint (any hint is valid, as it is always checked
+** before being used); quickened instructions count how many times
+** they had to be de-quickened.
+*/
+void luaF_newicache (lua_State *L, Proto *f) {
+  int i;
+  f->icache = luaM_newvector(L, f->sizecode, unsigned int);
+  f->sizeicache = f->sizecode;
+  for (i = 0; i < f->sizeicache; i++)
+    f->icache[i] = 0;
+}
+
+
 /*
 ** Look for n-th local variable at line 'line' in function 'func'.
 ** Returns NULL if not found.
@@ -118,6 +118,15 @@ static void reallymarkobject (global_State *g, GCObject *o);
 */
 #define gnodelast(h)	gnode(h, cast(size_t, sizenode(h)))
 
+/*
+** when a traversal of the hash part of 'h' reaches its end ('limit'),
+** continue with the old hash part of a table that is being resized
+** (see 'luaH_resize'), if there is one
+*/
+#define nextpart(h,n,limit)  \
+  ((h)->oldnode != NULL && (n) == gnodelast(h) && \
+   ((n) = (h)->oldnode, (limit) = (n) + sizeold(h), 1))
+
 
 /*
 ** link collectable object 'o' into list pointed by 'p'
@@ -268,7 +277,7 @@ static void reallymarkobject (global_State *g, GCObject *o) {
     }
     case LUA_TLNGSTR: {
       gray2black(o);
-      g->GCmemtrav += sizelstring(gco2ts(o)->u.lnglen);
+      g->GCmemtrav += sizelngstr(gco2ts(o));
       break;
     }
     case LUA_TUSERDATA: {
@@ -303,6 +312,19 @@ static void reallymarkobject (global_State *g, GCObject *o) {
       linkgclist(gco2p(o), g->gray);
       break;
     }
+    case LUA_TSHAPE: {  /* never gray: mark the chain of parents now */
+      Shape *s = gco2shape(o);
+      gray2black(o);
+      g->GCmemtrav += sizeshape(s);
+      /* other keys belong to ancestors, which are marked below */
+      if (s->nkeys > 0)
+        markobject(g, s->keys[s->nkeys - 1]);
+      if (s->parent != NULL && iswhite(s->parent)) {
+        o = obj2gco(s->parent);
+        goto reentry;
+      }
+      break;
+    }
     default: lua_assert(0); break;
   }
 }
@@ -393,10 +415,11 @@ static void restartcollection (global_State *g) {
 */
 static void traverseweakvalue (global_State *g, Table *h) {
   Node *n, *limit = gnodelast(h);
-  /* if there is array part, assume it may have white values (it is not
-     worth traversing it now just to check) */
-  int hasclears = (h->sizearray > 0);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+  /* if there is array part or fields, assume they may have white values
+     (it is not worth traversing them now just to check) */
+  int hasclears = (nboxed(h) > 0 || nfields(h) > 0);
+  /* traverse hash part */
+  for (n = gnode(h, 0); n < limit || nextpart(h, n, limit); n++) {
     checkdeadkey(n);
     if (ttisnil(gval(n)))  /* entry is empty? */
       removeentry(n);  /* remove it */
@@ -431,14 +454,21 @@ static int traverseephemeron (global_State *g, Table *h) {
   Node *n, *limit = gnodelast(h);
   unsigned int i;
   /* traverse array part */
-  for (i = 0; i < h->sizearray; i++) {
+  for (i = 0; i < nboxed(h); i++) {
     if (valiswhite(&h->array[i])) {
       marked = 1;
       reallymarkobject(g, gcvalue(&h->array[i]));
     }
   }
+  /* traverse fields (their keys are strings, which are never weak) */
+  for (i = 0; i < cast(unsigned int, nfields(h)); i++) {
+    if (valiswhite(&h->fields[i])) {
+      marked = 1;
+      reallymarkobject(g, gcvalue(&h->fields[i]));
+    }
+  }
   /* traverse hash part */
-  for (n = gnode(h, 0); n < limit; n++) {
+  for (n = gnode(h, 0); n < limit || nextpart(h, n, limit); n++) {
     checkdeadkey(n);
     if (ttisnil(gval(n)))  /* entry is empty? */
       removeentry(n);  /* remove it */
@@ -466,18 +496,30 @@ static int traverseephemeron (global_State *g, Table *h) {
 static void traversestrongtable (global_State *g, Table *h) {
   Node *n, *limit = gnodelast(h);
   unsigned int i;
-  for (i = 0; i < h->sizearray; i++)  /* traverse array part */
+  unsigned int ndead = 0;  /* number of dead entries in hash part */
+  int j;
+  for (i = 0; i < nboxed(h); i++)  /* traverse array part */
     markvalue(g, &h->array[i]);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+  for (j = 0; j < nfields(h); j++)  /* traverse fields */
+    markvalue(g, &h->fields[j]);
+  /* traverse hash part */
+  for (n = gnode(h, 0); n < limit || nextpart(h, n, limit); n++) {
     checkdeadkey(n);
-    if (ttisnil(gval(n)))  /* entry is empty? */
+    if (ttisnil(gval(n))) {  /* entry is empty? */
+      if (!ttisnil(gkey(n)))
+        ndead++;  /* it is still in a chain */
       removeentry(n);  /* remove it */
+    }
     else {
       lua_assert(!ttisnil(gkey(n)));
       markvalue(g, gkey(n));  /* mark key */
       markvalue(g, gval(n));  /* mark value */
     }
   }
+#if !defined(LUA_USE_GROUPHASH)
+  if (toomanydead(h, ndead))
+    h->status |= DIRTYBIT;  /* next insertion will compact it */
+#endif
 }
 
 
@@ -485,7 +527,10 @@ static lu_mem traversetable (global_State *g, Table *h) {
   const char *weakkey, *weakvalue;
   const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
   markobjectN(g, h->metatable);
-  if (mode && ttisstring(mode) &&  /* is there a weak mode? */
+  markobjectN(g, h->shape);  /* shape holds the keys of the fields */
+  if (isplain(h))
+    ;  /* nothing else to mark (see 'luaH_freeze') */
+  else if (mode && ttisstring(mode) &&  /* is there a weak mode? */
       ((weakkey = strchr(svalue(mode), 'k')),
        (weakvalue = strchr(svalue(mode), 'v')),
        (weakkey || weakvalue))) {  /* is really weak? */
@@ -500,7 +545,9 @@ static lu_mem traversetable (global_State *g, Table *h) {
   else  /* not weak */
     traversestrongtable(g, h);
   return sizeof(Table) + sizeof(TValue) * h->sizearray +
-                         sizeof(Node) * cast(size_t, allocsizenode(h));
+                         sizeof(TValue) * h->sizefields +
+                         sizeof(Node) * cast(size_t, allocsizenode(h)) +
+                         (h->oldnode ? sizeof(Node) * sizeold(h) : 0);
 }
 
 
@@ -527,7 +574,8 @@ static int traverseproto (global_State *g, Proto *f) {
                          sizeof(TValue) * f->sizek +
                          sizeof(int) * f->sizelineinfo +
                          sizeof(LocVar) * f->sizelocvars +
-                         sizeof(Upvaldesc) * f->sizeupvalues;
+                         sizeof(Upvaldesc) * f->sizeupvalues +
+                         sizeof(unsigned int) * f->sizeicache;
 }
 
 
@@ -675,7 +723,7 @@ static void clearkeys (global_State *g, GCObject *l, GCObject *f) {
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
     Node *n, *limit = gnodelast(h);
-    for (n = gnode(h, 0); n < limit; n++) {
+    for (n = gnode(h, 0); n < limit || nextpart(h, n, limit); n++) {
       if (!ttisnil(gval(n)) && (iscleared(g, gkey(n)))) {
         setnilvalue(gval(n));  /* remove value ... */
         removeentry(n);  /* and remove entry from table */
@@ -685,6 +733,26 @@ static void clearkeys (global_State *g, GCObject *l, GCObject *f) {
 }
 
 
+/*
+** remove dead shapes from the transitions of shape 's' and its live
+** descendants. A shape is dead only if all its descendants are dead
+** too (children keep their parents alive), so there is no need to
+** visit them.
+*/
+static void clearshapes (Shape *s) {
+  Shape **p = &s->child;
+  while (*p != NULL) {
+    Shape *c = *p;
+    if (iswhite(c))
+      *p = c->sibling;  /* unlink dead shape */
+    else {
+      clearshapes(c);
+      p = &c->sibling;
+    }
+  }
+}
+
+
 /*
 ** clear entries with unmarked values from all weaktables in list 'l' up
 ** to element 'f'
@@ -694,12 +762,18 @@ static void clearvalues (global_State *g, GCObject *l, GCObject *f) {
     Table *h = gco2t(l);
     Node *n, *limit = gnodelast(h);
     unsigned int i;
-    for (i = 0; i < h->sizearray; i++) {
+    int j;
+    for (i = 0; i < nboxed(h); i++) {
       TValue *o = &h->array[i];
       if (iscleared(g, o))  /* value was collected? */
         setnilvalue(o);  /* remove value */
     }
-    for (n = gnode(h, 0); n < limit; n++) {
+    for (j = 0; j < nfields(h); j++) {
+      TValue *o = &h->fields[j];
+      if (iscleared(g, o))  /* value was collected? */
+        setnilvalue(o);  /* remove value (its key stays in the shape) */
+    }
+    for (n = gnode(h, 0); n < limit || nextpart(h, n, limit); n++) {
       if (!ttisnil(gval(n)) && iscleared(g, gval(n))) {
         setnilvalue(gval(n));  /* remove value ... */
         removeentry(n);  /* and remove entry from table */
@@ -760,9 +834,15 @@ static void freeobj (lua_State *L, GCObject *o) {
       luaM_freemem(L, o, sizelstring(gco2ts(o)->shrlen));
       break;
     case LUA_TLNGSTR: {
-      luaM_freemem(L, o, sizelstring(gco2ts(o)->u.lnglen));
+      TString *ts = gco2ts(o);
+      if (isbufstr(ts))  /* bytes in a buffer? */
+        luaS_releasebuf(L, strbuf(ts));
+      else if (isextstr(ts))  /* bytes owned by the host? */
+        luaS_freeext(ts);
+      luaM_freemem(L, o, sizelngstr(ts));
       break;
     }
+    case LUA_TSHAPE: luaM_freemem(L, o, sizeshape(gco2shape(o))); break;
     default: lua_assert(0);
   }
 }
@@ -880,9 +960,10 @@ static void GCTM (lua_State *L, int propagateerrors) {
     g->gcrunning = running;  /* restore state */
     if (status != LUA_OK && propagateerrors) {  /* error while running __gc? */
       if (status == LUA_ERRRUN) {  /* is there an error object? */
-        const char *msg = (ttisstring(L->top - 1))
-                            ? svalue(L->top - 1)
-                            : "no message";
+        const char *msg;
+        if (ttislngstring(L->top - 1))
+          luaS_flatten(L, tsvalue(L->top - 1), 0);  /* '%s' needs a '\0' */
+        msg = (ttisstring(L->top - 1)) ? svalue(L->top - 1) : "no message";
         luaO_pushfstring(L, "error in __gc metamethod (%s)", msg);
         status = LUA_ERRGCMM;  /* error in __gc metamethod */
       }
@@ -1075,6 +1156,8 @@ static l_mem atomic (lua_State *L) {
   clearvalues(g, g->weak, origweak);
   clearvalues(g, g->allweak, origall);
   luaS_clearcache(g);
+  if (g->emptyshape != NULL)
+    clearshapes(g->emptyshape);  /* remove dead transitions */
   g->currentwhite = cast_byte(otherwhite(g));  /* flip current white */
   work += g->GCmemtrav;  /* complete counting */
   return work;  /* estimate of memory marked by 'atomic' */
@@ -1203,6 +1286,8 @@ void luaC_step (lua_State *L) {
     luaE_setdebt(g, debt);
     runafewfinalizers(L);
   }
+  if (g->strt.oldhash != NULL)  /* string table being resized? */
+    luaS_migrate(L, LUAI_STRMIGRATESTEP);  /* help move it */
 }
 
 
@@ -52,6 +52,9 @@ static const luaL_Reg loadedlibs[] = {
   {LUA_DBLIBNAME, luaopen_debug},
 #if defined(LUA_COMPAT_BITLIB)
   {LUA_BITLIBNAME, luaopen_bit32},
+#endif
+#if defined(LUA_USE_JIT)
+  {LUA_JITLIBNAME, luaopen_jit},
 #endif
   {NULL, NULL}
 };
@@ -0,0 +1,992 @@
+/*
+** $Id: ljit.c $
+** Baseline compiler from Lua bytecode to x86-64 machine code
+** See Copyright Notice in lua.h
+*/
+
+#define ljit_c
+#define LUA_CORE
+
+#if !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE  /* for MAP_ANONYMOUS */
+#endif
+
+#include "lprefix.h"
+
+
+#if defined(LUA_USE_JIT)	/* { */
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "lua.h"
+
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "ljit.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lstate.h"
+#include "ltable.h"
+#include "ltm.h"
+#include "lvm.h"
+
+
+/*
+** The compiler translates each instruction of a prototype into a fixed
+** machine-code template, in a single pass and without any analysis.
+** Native code shares all state with the interpreter (the frame's stack
+** slots and 'savedpc'), so it can start at any instruction and give
+** control back to the interpreter at any instruction:
+**
+** - simple instructions (moves, loads, jumps, numeric 'for' loops,
+**   and the integer/float cases of arithmetic and comparisons) are
+**   fully inlined;
+** - table accesses, the generic cases of arithmetic and comparisons,
+**   and a few others call a C helper that does exactly what the
+**   interpreter does (luaV_finishget, luaT_trybinTM, etc.);
+** - everything else (calls, returns, closures, concatenation, ...)
+**   is an "exit": native code stores the instruction's address in
+**   'savedpc' and returns; the interpreter executes that instruction
+**   and then reenters native code at the next one (see 'vmfetch').
+**
+** Calls are always exits, so native code never has a Lua function
+** running below it in the C stack; coroutines can yield anywhere.
+** Native code only runs without line/count hooks; backward jumps check
+** 'hookmask' to give control back to the interpreter when a hook is
+** set while a loop runs.
+*/
+
+
+/*
+** maximum size of a prototype that will be compiled. The compiler's
+** buffers come from the state's allocator, but native code must live
+** in executable pages, which come straight from 'mmap'; their size is
+** only added to the GC debt, so that the collector (and the 'count'
+** of 'collectgarbage') sees them, but the allocator does not.
+*/
+#if !defined(LUAI_MAXJITCODE)
+#define LUAI_MAXJITCODE		(1 << 16)
+#endif
+
+
+/* signature of the entry point of native code */
+typedef void (*JitFunction) (lua_State *L, CallInfo *ci, const void *target);
+
+
+typedef struct JitCode {
+  size_t size;  /* size of the whole memory block */
+  JitFunction entry;
+  const unsigned char *addr[1];  /* native address for each instruction */
+} JitCode;
+
+
+/* x86-64 registers */
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+       R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/* registers that keep the interpreter state inside native code */
+#define RBASE	RBX	/* 'base' (reloaded after each helper) */
+#define RL	R12	/* 'L' */
+#define RCI	R13	/* 'ci' */
+#define RK	R14	/* 'k' */
+#define RCL	R15	/* 'cl' */
+
+/* condition codes */
+#define CC_ALWAYS	(-1)
+#define CC_E		0x4
+#define CC_NE		0x5
+#define CC_L		0xC
+#define CC_GE		0xD
+#define CC_LE		0xE
+#define CC_G		0xF
+
+/* opcodes with a 'reg, r/m' or 'r/m, reg' form */
+#define X_ADD		0x01	/* r/m += reg */
+#define X_MOVST		0x89	/* r/m = reg */
+#define X_MOVLD		0x8B	/* reg = r/m */
+#define X_CMPST		0x39	/* compare r/m with reg */
+#define X_CMPLD		0x3B	/* compare reg with r/m */
+#define X_TEST		0x85
+#define X_ADDLD		0x03	/* reg += r/m */
+#define X_SUBLD		0x2B	/* reg -= r/m */
+#define X_IMULLD	0x0FAF	/* reg *= r/m */
+
+/* SSE2 scalar double opcodes (after 0xF2 0x0F) */
+#define S_LOAD		0x10
+#define S_STORE		0x11
+#define S_ADD		0x58
+#define S_MUL		0x59
+#define S_SUB		0x5C
+
+
+/* offsets of fields used by native code */
+#define VALOFF		cast_int(offsetof(TValue, value_))
+#define TTOFF		cast_int(offsetof(TValue, tt_))
+#define TVSIZE		cast_int(sizeof(TValue))
+#define RDISP(x)	(cast_int(x) * TVSIZE)
+
+
+typedef struct JitFix {
+  size_t pos;  /* position of a jump displacement in 'code' */
+  int target;  /* instruction it jumps to */
+} JitFix;
+
+
+typedef struct JitState {
+  lua_State *L;
+  Proto *p;
+  unsigned char *code;  /* code buffer */
+  size_t size;  /* size of 'code' */
+  size_t n;  /* number of bytes in 'code' */
+  size_t *label;  /* position of each instruction in 'code' */
+  JitFix *fix;  /* jumps to instructions */
+  int nfix;  /* number of elements in 'fix' */
+  size_t epilogue;  /* position of the code that returns to the caller */
+} JitState;
+
+
+/* list of forward jumps to the same (still unknown) position */
+typedef struct JumpList {
+  size_t pos[4];
+  int n;
+} JumpList;
+
+
+/* location of an RK operand */
+typedef struct Operand {
+  int reg;  /* base register */
+  int disp;  /* displacement from 'reg' */
+  const TValue *k;  /* constant value (NULL for registers) */
+} Operand;
+
+
+/*
+** {======================================================
+** Machine-code emission
+** =======================================================
+*/
+
+static void emitb (JitState *J, int b) {
+  if (J->n >= J->size) {
+    luaM_reallocvector(J->L, J->code, J->size, J->size * 2, unsigned char);
+    J->size *= 2;
+  }
+  J->code[J->n++] = cast(unsigned char, b);
+}
+
+
+static void emit32 (JitState *J, unsigned int v) {
+  int i;
+  for (i = 0; i < 4; i++, v >>= 8)
+    emitb(J, cast_int(v & 0xFF));
+}
+
+
+static void emit64 (JitState *J, size_t v) {
+  int i;
+  for (i = 0; i < 8; i++, v >>= 8)
+    emitb(J, cast_int(v & 0xFF));
+}
+
+
+/* REX prefix ('w' selects 64-bit operands); omitted when not needed */
+static void rex (JitState *J, int w, int r, int b) {
+  int v = 0x40 | (w << 3) | ((r & 8) >> 1) | ((b & 8) >> 3);
+  if (v != 0x40) emitb(J, v);
+}
+
+
+/* ModRM (and SIB) for operand '[b + disp]' */
+static void modmem (JitState *J, int r, int b, int disp) {
+  emitb(J, 0x80 | ((r & 7) << 3) | (b & 7));
+  if ((b & 7) == RSP)  /* 'rsp' and 'r12' need a SIB byte */
+    emitb(J, 0x24);
+  emit32(J, cast(unsigned int, disp));
+}
+
+
+/* ModRM for register-to-register operands */
+static void modreg (JitState *J, int r, int b) {
+  emitb(J, 0xC0 | ((r & 7) << 3) | (b & 7));
+}
+
+
+/* 'op' with operands 'r' and '[b + disp]' */
+static void opmem (JitState *J, int w, int op, int r, int b, int disp) {
+  rex(J, w, r, b);
+  if (op > 0xFF) emitb(J, op >> 8);  /* two-byte opcode */
+  emitb(J, op & 0xFF);
+  modmem(J, r, b, disp);
+}
+
+
+/* 'op' with register operands 'd' (r/m) and 's' (reg) */
+static void opreg (JitState *J, int op, int d, int s) {
+  rex(J, 1, s, d);
+  emitb(J, op);
+  modreg(J, s, d);
+}
+
+
+/* mov dword [b + disp], imm */
+static void storeimm (JitState *J, int b, int disp, int imm) {
+  rex(J, 0, 0, b);
+  emitb(J, 0xC7);
+  modmem(J, 0, b, disp);
+  emit32(J, cast(unsigned int, imm));
+}
+
+
+/* cmp (d|q)word [b + disp], imm */
+static void cmpimm (JitState *J, int w, int b, int disp, int imm) {
+  rex(J, w, 0, b);
+  emitb(J, 0x81);
+  modmem(J, 7, b, disp);
+  emit32(J, cast(unsigned int, imm));
+}
+
+
+/* add/sub ('ext' 0/5) qword register, imm */
+static void aluimm (JitState *J, int ext, int r, int imm) {
+  rex(J, 1, 0, r);
+  emitb(J, 0x81);
+  modreg(J, ext, r);
+  emit32(J, cast(unsigned int, imm));
+}
+
+
+/* mov register, imm64 */
+static void loadimm (JitState *J, int r, size_t v) {
+  rex(J, 1, 0, r);
+  emitb(J, 0xB8 + (r & 7));
+  emit64(J, v);
+}
+
+
+/* mov register (32 bits, zero extended), imm32 */
+static void loadimm32 (JitState *J, int r, unsigned int v) {
+  rex(J, 0, 0, r);
+  emitb(J, 0xB8 + (r & 7));
+  emit32(J, v);
+}
+
+
+/* SSE2 scalar operation between 'xmm0' and '[b + disp]' */
+static void sseop (JitState *J, int op, int b, int disp) {
+  emitb(J, 0xF2);
+  rex(J, 0, 0, b);
+  emitb(J, 0x0F);
+  emitb(J, op);
+  modmem(J, 0, b, disp);
+}
+
+
+static void push (JitState *J, int r) {
+  rex(J, 0, 0, r);
+  emitb(J, 0x50 + (r & 7));
+}
+
+
+static void pop (JitState *J, int r) {
+  rex(J, 0, 0, r);
+  emitb(J, 0x58 + (r & 7));
+}
+
+
+/*
+** emit a jump (conditional unless 'cc' is CC_ALWAYS) with a
+** displacement to be patched later; return the displacement's position
+*/
+static size_t jump (JitState *J, int cc) {
+  if (cc == CC_ALWAYS)
+    emitb(J, 0xE9);
+  else {
+    emitb(J, 0x0F);
+    emitb(J, 0x80 | cc);
+  }
+  emit32(J, 0);
+  return J->n - 4;
+}
+
+
+static void patch (JitState *J, size_t pos, size_t target) {
+  unsigned int d = cast(unsigned int, target - (pos + 4));
+  int i;
+  for (i = 0; i < 4; i++, d >>= 8)
+    J->code[pos + i] = cast(unsigned char, d & 0xFF);
+}
+
+
+static void patchhere (JitState *J, size_t pos) {
+  patch(J, pos, J->n);
+}
+
+
+static void addjump (JumpList *l, size_t pos) {
+  lua_assert(l->n < cast_int(sizeof(l->pos) / sizeof(l->pos[0])));
+  l->pos[l->n++] = pos;
+}
+
+
+static void patchlisthere (JitState *J, JumpList *l) {
+  int i;
+  for (i = 0; i < l->n; i++)
+    patchhere(J, l->pos[i]);
+  l->n = 0;
+}
+
+
+/* jump to the code of instruction 'target' */
+static void jumppc (JitState *J, int cc, int target) {
+  J->fix[J->nfix].pos = jump(J, cc);
+  J->fix[J->nfix].target = target;
+  J->nfix++;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Instruction templates
+** =======================================================
+*/
+
+/* store the address of instruction 'pc' into 'ci->u.l.savedpc' */
+static void setsavedpc (JitState *J, int pc) {
+  loadimm(J, RAX, cast(size_t, J->p->code + pc));
+  opmem(J, 1, X_MOVST, RAX, RCI, cast_int(offsetof(CallInfo, u.l.savedpc)));
+}
+
+
+/* give control back to the interpreter at instruction 'pc' */
+static void exitto (JitState *J, int pc) {
+  setsavedpc(J, pc);
+  patch(J, jump(J, CC_ALWAYS), J->epilogue);
+}
+
+
+/*
+** call helper 'f' for instruction 'i' (at 'pc'); as with 'Protect' in
+** the interpreter, 'savedpc' is updated before the call (for errors and
+** yields) and 'base' is reloaded after it
+*/
+static void callhelper (JitState *J, size_t f, Instruction i, int pc) {
+  setsavedpc(J, pc + 1);
+  opreg(J, X_MOVST, RDI, RL);
+  opreg(J, X_MOVST, RSI, RCI);
+  loadimm32(J, RDX, i);
+  loadimm32(J, RCX, cast(unsigned int, pc));
+  loadimm(J, RAX, f);
+  emitb(J, 0xFF); modreg(J, 2, RAX);  /* call rax */
+  opmem(J, 1, X_MOVLD, RBASE, RCI, cast_int(offsetof(CallInfo, u.l.base)));
+}
+
+
+/* jump to instruction 'target', checking for hooks in backward jumps */
+static void jumpto (JitState *J, int pc, int target) {
+  if (target > pc)
+    jumppc(J, CC_ALWAYS, target);
+  else {
+    cmpimm(J, 0, RL, cast_int(offsetof(lua_State, hookmask)), 0);
+    jumppc(J, CC_E, target);
+    exitto(J, target);
+  }
+}
+
+
+static void rkoperand (JitState *J, int x, Operand *o) {
+  if (ISK(x)) {
+    o->reg = RK;
+    o->disp = RDISP(INDEXK(x));
+    o->k = J->p->k + INDEXK(x);
+  }
+  else {
+    o->reg = RBASE;
+    o->disp = RDISP(x);
+    o->k = NULL;
+  }
+}
+
+
+/* add to 'l' a jump taken when operand 'o' does not have tag 'tt' */
+static void guardtag (JitState *J, const Operand *o, int tt, JumpList *l) {
+  if (o->k != NULL) {  /* constant: tag is known now */
+    if (rttype(o->k) != tt)
+      addjump(l, jump(J, CC_ALWAYS));
+  }
+  else {
+    cmpimm(J, 0, o->reg, o->disp + TTOFF, tt);
+    addjump(l, jump(J, CC_NE));
+  }
+}
+
+
+/* copy a whole TValue (value and tag) */
+static void copytv (JitState *J, int dreg, int ddisp, int sreg, int sdisp) {
+  opmem(J, 1, X_MOVLD, RAX, sreg, sdisp + VALOFF);
+  opmem(J, 1, X_MOVLD, RCX, sreg, sdisp + TTOFF);
+  opmem(J, 1, X_MOVST, RAX, dreg, ddisp + VALOFF);
+  opmem(J, 1, X_MOVST, RCX, dreg, ddisp + TTOFF);
+}
+
+
+/*
+** branches of a test followed by a jump: when the test is true ('cc'),
+** go to the jump instruction if 'cond', otherwise skip it
+*/
+static void condjump (JitState *J, int cc, int pc, int cond) {
+  jumppc(J, cc, cond ? pc + 1 : pc + 2);
+  jumppc(J, CC_ALWAYS, cond ? pc + 2 : pc + 1);
+}
+
+
+/* add to 'l' a jump taken when the value at '[reg + disp]' is false */
+static void jumpiffalse (JitState *J, int reg, int disp, JumpList *l) {
+  size_t istrue;
+  opmem(J, 0, X_MOVLD, RAX, reg, disp + TTOFF);
+  emitb(J, X_TEST); modreg(J, RAX, RAX);  /* test eax, eax */
+  addjump(l, jump(J, CC_E));  /* nil */
+  emitb(J, 0x83); modreg(J, 7, RAX); emitb(J, LUA_TBOOLEAN);  /* cmp eax, imm8 */
+  istrue = jump(J, CC_NE);
+  cmpimm(J, 0, reg, disp + VALOFF, 0);
+  addjump(l, jump(J, CC_E));  /* false */
+  patchhere(J, istrue);
+}
+
+
+static void jit_arith (lua_State *L, CallInfo *ci, Instruction i, int pc);
+static int jit_compare (lua_State *L, CallInfo *ci, Instruction i, int pc);
+static void jit_gettable (lua_State *L, CallInfo *ci, Instruction i, int pc);
+static void jit_settable (lua_State *L, CallInfo *ci, Instruction i, int pc);
+static void jit_setupval (lua_State *L, CallInfo *ci, Instruction i, int pc);
+static void jit_close (lua_State *L, CallInfo *ci, Instruction i, int pc);
+
+#define helper(f)	cast(size_t, f)
+
+
+/* ADD, SUB, and MUL: inline integer and float cases */
+static void arith (JitState *J, Instruction i, int pc, int iop, int fop) {
+  int ra = RDISP(GETARG_A(i));
+  Operand b, c;
+  JumpList tofloat = {{0}, 0}, toslow = {{0}, 0};
+  size_t done1, done2;
+  rkoperand(J, GETARG_B(i), &b);
+  rkoperand(J, GETARG_C(i), &c);
+  guardtag(J, &b, LUA_TNUMINT, &tofloat);
+  guardtag(J, &c, LUA_TNUMINT, &toslow);
+  opmem(J, 1, X_MOVLD, RAX, b.reg, b.disp + VALOFF);
+  opmem(J, 1, iop, RAX, c.reg, c.disp + VALOFF);  /* wraps around */
+  opmem(J, 1, X_MOVST, RAX, RBASE, ra + VALOFF);
+  storeimm(J, RBASE, ra + TTOFF, LUA_TNUMINT);
+  done1 = jump(J, CC_ALWAYS);
+  patchlisthere(J, &tofloat);
+  guardtag(J, &b, LUA_TNUMFLT, &toslow);
+  guardtag(J, &c, LUA_TNUMFLT, &toslow);
+  sseop(J, S_LOAD, b.reg, b.disp + VALOFF);
+  sseop(J, fop, c.reg, c.disp + VALOFF);
+  sseop(J, S_STORE, RBASE, ra + VALOFF);
+  storeimm(J, RBASE, ra + TTOFF, LUA_TNUMFLT);
+  done2 = jump(J, CC_ALWAYS);
+  patchlisthere(J, &toslow);
+  callhelper(J, helper(jit_arith), i, pc);
+  patchhere(J, done1);
+  patchhere(J, done2);
+}
+
+
+/* ADDI and SUBI: inline integer case */
+static void arithimm (JitState *J, Instruction i, int pc, int ext) {
+  int ra = RDISP(GETARG_A(i));
+  int rb = RDISP(GETARG_B(i));
+  size_t slow, done;
+  cmpimm(J, 0, RBASE, rb + TTOFF, LUA_TNUMINT);
+  slow = jump(J, CC_NE);
+  opmem(J, 1, X_MOVLD, RAX, RBASE, rb + VALOFF);
+  aluimm(J, ext, RAX, GETARG_sC(i));
+  opmem(J, 1, X_MOVST, RAX, RBASE, ra + VALOFF);
+  storeimm(J, RBASE, ra + TTOFF, LUA_TNUMINT);
+  done = jump(J, CC_ALWAYS);
+  patchhere(J, slow);
+  callhelper(J, helper(jit_arith), i, pc);
+  patchhere(J, done);
+}
+
+
+/* generic comparison through a helper */
+static void comparehelper (JitState *J, Instruction i, int pc) {
+  callhelper(J, helper(jit_compare), i, pc);
+  emitb(J, X_TEST); modreg(J, RAX, RAX);  /* test eax, eax */
+  condjump(J, CC_NE, pc, GETARG_A(i) & 1);
+}
+
+
+/* EQ, LT, and LE: inline integer case */
+static void compare (JitState *J, Instruction i, int pc, int cc) {
+  Operand b, c;
+  JumpList toslow = {{0}, 0};
+  rkoperand(J, GETARG_B(i), &b);
+  rkoperand(J, GETARG_C(i), &c);
+  guardtag(J, &b, LUA_TNUMINT, &toslow);
+  guardtag(J, &c, LUA_TNUMINT, &toslow);
+  opmem(J, 1, X_MOVLD, RAX, b.reg, b.disp + VALOFF);
+  opmem(J, 1, X_CMPLD, RAX, c.reg, c.disp + VALOFF);
+  condjump(J, cc, pc, GETARG_A(i));
+  patchlisthere(J, &toslow);
+  comparehelper(J, i, pc);
+}
+
+
+/* EQI, LTI, and LEI: inline integer case */
+static void compareimm (JitState *J, Instruction i, int pc, int cc) {
+  int rb = RDISP(GETARG_B(i));
+  size_t slow;
+  cmpimm(J, 0, RBASE, rb + TTOFF, LUA_TNUMINT);
+  slow = jump(J, CC_NE);
+  cmpimm(J, 1, RBASE, rb + VALOFF, GETARG_sC(i));
+  condjump(J, cc, pc, GETARG_A(i) & 1);
+  patchhere(J, slow);
+  comparehelper(J, i, pc);
+}
+
+
+static void test (JitState *J, Instruction i, int pc) {
+  JumpList isfalse = {{0}, 0};
+  int c = GETARG_C(i);
+  jumpiffalse(J, RBASE, RDISP(GETARG_A(i)), &isfalse);
+  jumppc(J, CC_ALWAYS, c ? pc + 1 : pc + 2);
+  patchlisthere(J, &isfalse);
+  jumppc(J, CC_ALWAYS, c ? pc + 2 : pc + 1);
+}
+
+
+static void testset (JitState *J, Instruction i, int pc) {
+  JumpList isfalse = {{0}, 0};
+  int ra = RDISP(GETARG_A(i));
+  int rb = RDISP(GETARG_B(i));
+  int c = GETARG_C(i);
+  jumpiffalse(J, RBASE, rb, &isfalse);
+  if (c) copytv(J, RBASE, ra, RBASE, rb);
+  jumppc(J, CC_ALWAYS, c ? pc + 1 : pc + 2);
+  patchlisthere(J, &isfalse);
+  if (!c) copytv(J, RBASE, ra, RBASE, rb);
+  jumppc(J, CC_ALWAYS, c ? pc + 2 : pc + 1);
+}
+
+
+/* integer loops run natively; float loops exit to the interpreter */
+static void forloop (JitState *J, Instruction i, int pc) {
+  int ra = RDISP(GETARG_A(i));
+  size_t isfloat, negstep, done1, done2, loop;
+  cmpimm(J, 0, RBASE, ra + TTOFF, LUA_TNUMINT);
+  isfloat = jump(J, CC_NE);
+  opmem(J, 1, X_MOVLD, RAX, RBASE, ra + VALOFF);  /* index */
+  opmem(J, 1, X_MOVLD, RCX, RBASE, ra + RDISP(2) + VALOFF);  /* step */
+  opreg(J, X_ADD, RAX, RCX);  /* wraps around */
+  opmem(J, 1, X_MOVLD, RDX, RBASE, ra + RDISP(1) + VALOFF);  /* limit */
+  opreg(J, X_TEST, RCX, RCX);
+  negstep = jump(J, CC_LE);
+  opreg(J, X_CMPST, RAX, RDX);  /* index > limit? */
+  done1 = jump(J, CC_G);
+  loop = jump(J, CC_ALWAYS);
+  patchhere(J, negstep);
+  opreg(J, X_CMPST, RDX, RAX);  /* limit > index? */
+  done2 = jump(J, CC_G);
+  patchhere(J, loop);
+  opmem(J, 1, X_MOVST, RAX, RBASE, ra + VALOFF);
+  opmem(J, 1, X_MOVST, RAX, RBASE, ra + RDISP(3) + VALOFF);
+  storeimm(J, RBASE, ra + RDISP(3) + TTOFF, LUA_TNUMINT);
+  jumpto(J, pc, pc + 1 + GETARG_sBx(i));
+  patchhere(J, done1);
+  patchhere(J, done2);
+  jumppc(J, CC_ALWAYS, pc + 1);
+  patchhere(J, isfloat);
+  exitto(J, pc);
+}
+
+
+static void instruction (JitState *J, Instruction i, int pc) {
+  int ra = RDISP(GETARG_A(i));
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: {
+      copytv(J, RBASE, ra, RBASE, RDISP(GETARG_B(i)));
+      break;
+    }
+    case OP_LOADK: {
+      copytv(J, RBASE, ra, RK, RDISP(GETARG_Bx(i)));
+      break;
+    }
+    case OP_LOADBOOL: {
+      storeimm(J, RBASE, ra + VALOFF, GETARG_B(i));
+      storeimm(J, RBASE, ra + TTOFF, LUA_TBOOLEAN);
+      if (GETARG_C(i)) jumppc(J, CC_ALWAYS, pc + 2);
+      break;
+    }
+    case OP_LOADNIL: {
+      int b;
+      for (b = 0; b <= GETARG_B(i); b++)
+        storeimm(J, RBASE, ra + RDISP(b) + TTOFF, LUA_TNIL);
+      break;
+    }
+    case OP_GETUPVAL: {
+      opmem(J, 1, X_MOVLD, RDX, RCL, cast_int(offsetof(LClosure, upvals)) +
+                                     GETARG_B(i) * cast_int(sizeof(UpVal *)));
+      opmem(J, 1, X_MOVLD, RDX, RDX, cast_int(offsetof(UpVal, v)));
+      copytv(J, RBASE, ra, RDX, 0);  /* ('copytv' uses RAX and RCX) */
+      break;
+    }
+    case OP_GETTABUP: case OP_GETTABLE: case OP_GETFIELD:
+    case OP_GETI: case OP_SELF: case OP_SELFCALL: {
+      callhelper(J, helper(jit_gettable), i, pc);
+      break;
+    }
+    case OP_SETTABUP: case OP_SETTABLE: {
+      callhelper(J, helper(jit_settable), i, pc);
+      break;
+    }
+    case OP_SETUPVAL: {
+      callhelper(J, helper(jit_setupval), i, pc);
+      break;
+    }
+    case OP_ADD: {
+      arith(J, i, pc, X_ADDLD, S_ADD);
+      break;
+    }
+    case OP_SUB: {
+      arith(J, i, pc, X_SUBLD, S_SUB);
+      break;
+    }
+    case OP_MUL: {
+      arith(J, i, pc, X_IMULLD, S_MUL);
+      break;
+    }
+    case OP_ADDI: {
+      arithimm(J, i, pc, 0);
+      break;
+    }
+    case OP_SUBI: {
+      arithimm(J, i, pc, 5);
+      break;
+    }
+    case OP_MOD: case OP_POW: case OP_DIV: case OP_IDIV:
+    case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+    case OP_UNM: case OP_BNOT: {
+      callhelper(J, helper(jit_arith), i, pc);
+      break;
+    }
+    case OP_JMP: {
+      if (GETARG_A(i) != 0)
+        callhelper(J, helper(jit_close), i, pc);
+      jumpto(J, pc, pc + 1 + GETARG_sBx(i));
+      break;
+    }
+    case OP_EQ: {
+      compare(J, i, pc, CC_E);
+      break;
+    }
+    case OP_LT: {
+      compare(J, i, pc, CC_L);
+      break;
+    }
+    case OP_LE: {
+      compare(J, i, pc, CC_LE);
+      break;
+    }
+    case OP_EQI: {
+      compareimm(J, i, pc, CC_E);
+      break;
+    }
+    case OP_LTI: {
+      compareimm(J, i, pc, (GETARG_A(i) & BITIMMFIRST) ? CC_G : CC_L);
+      break;
+    }
+    case OP_LEI: {
+      compareimm(J, i, pc, (GETARG_A(i) & BITIMMFIRST) ? CC_GE : CC_LE);
+      break;
+    }
+    case OP_TEST: {
+      test(J, i, pc);
+      break;
+    }
+    case OP_TESTSET: {
+      testset(J, i, pc);
+      break;
+    }
+    case OP_FORLOOP: {
+      forloop(J, i, pc);
+      break;
+    }
+    default: {  /* let the interpreter do it */
+      exitto(J, pc);
+      break;
+    }
+  }
+}
+
+
+/*
+** entry point: save callee-saved registers, load the interpreter state
+** into its registers, and jump to the target instruction. The epilogue
+** comes right after it.
+*/
+static void prologue (JitState *J) {
+  push(J, RBX); push(J, RBP);
+  push(J, R12); push(J, R13); push(J, R14); push(J, R15);
+  aluimm(J, 5, RSP, 8);  /* keep the stack aligned for helpers */
+  opreg(J, X_MOVST, RL, RDI);
+  opreg(J, X_MOVST, RCI, RSI);
+  opmem(J, 1, X_MOVLD, RBASE, RCI, cast_int(offsetof(CallInfo, u.l.base)));
+  opmem(J, 1, X_MOVLD, RAX, RCI, cast_int(offsetof(CallInfo, func)));
+  opmem(J, 1, X_MOVLD, RCL, RAX, VALOFF);
+  loadimm(J, RK, cast(size_t, J->p->k));
+  rex(J, 0, 0, RDX); emitb(J, 0xFF); modreg(J, 4, RDX);  /* jmp rdx */
+  J->epilogue = J->n;
+  aluimm(J, 0, RSP, 8);
+  pop(J, R15); pop(J, R14); pop(J, R13); pop(J, R12);
+  pop(J, RBP); pop(J, RBX);
+  emitb(J, 0xC3);  /* ret */
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Helpers called from native code
+** (each one does what the interpreter does for its instructions)
+** =======================================================
+*/
+
+/*
+** The interpreter may quicken an instruction after it was compiled
+** (native code is always compiled from the generic form). Before
+** anything that can call a metamethod, arithmetic and comparisons store
+** their generic form back, as 'dequicken' does, so that the interpreter
+** does not take the quickened path for operands it cannot handle.
+** ('luaV_finishOp' and 'funcnamefromcode' accept both forms.)
+*/
+#define setgeneric(ci,i,pc)	(clLvalue((ci)->func)->p->code[pc] = (i))
+
+
+#define RB(i)	(base+GETARG_B(i))
+#define RKB(i)	(ISK(GETARG_B(i)) ? k+INDEXK(GETARG_B(i)) : base+GETARG_B(i))
+#define RKC(i)	(ISK(GETARG_C(i)) ? k+INDEXK(GETARG_C(i)) : base+GETARG_C(i))
+
+
+static void jit_arith (lua_State *L, CallInfo *ci, Instruction i, int pc) {
+  StkId base = ci->u.l.base;
+  TValue *k = clLvalue(ci->func)->p->k;
+  StkId ra = base + GETARG_A(i);
+  TValue aux;
+  int op;
+  setgeneric(ci, i, pc);
+  switch (GET_OPCODE(i)) {
+    case OP_ADDI: case OP_SUBI: {
+      setivalue(&aux, GETARG_sC(i));
+      luaO_arith(L, (GET_OPCODE(i) == OP_ADDI) ? LUA_OPADD : LUA_OPSUB,
+                    RB(i), &aux, ra);
+      return;
+    }
+    case OP_UNM: case OP_BNOT: {
+      luaO_arith(L, (GET_OPCODE(i) == OP_UNM) ? LUA_OPUNM : LUA_OPBNOT,
+                    RB(i), RB(i), ra);
+      return;
+    }
+    default:
+      lua_assert(OP_ADD <= GET_OPCODE(i) && GET_OPCODE(i) <= OP_SHR);
+      op = cast_int(GET_OPCODE(i) - OP_ADD) + LUA_OPADD;
+      break;
+  }
+  luaO_arith(L, op, RKB(i), RKC(i), ra);
+}
+
+
+static int jit_compare (lua_State *L, CallInfo *ci, Instruction i, int pc) {
+  StkId base = ci->u.l.base;
+  TValue *k = clLvalue(ci->func)->p->k;
+  TValue aux;
+  setgeneric(ci, i, pc);
+  switch (GET_OPCODE(i)) {
+    case OP_EQ: return luaV_equalobj(L, RKB(i), RKC(i));
+    case OP_LT: return luaV_lessthan(L, RKB(i), RKC(i));
+    case OP_LE: return luaV_lessequal(L, RKB(i), RKC(i));
+    case OP_EQI: {
+      setivalue(&aux, GETARG_sC(i));
+      return luaV_equalobj(L, RB(i), &aux);
+    }
+    case OP_LTI: {
+      setivalue(&aux, GETARG_sC(i));
+      return (GETARG_A(i) & BITIMMFIRST) ? luaV_lessthan(L, &aux, RB(i))
+                                          : luaV_lessthan(L, RB(i), &aux);
+    }
+    case OP_LEI: {
+      setivalue(&aux, GETARG_sC(i));
+      return (GETARG_A(i) & BITIMMFIRST) ? luaV_lessequal(L, &aux, RB(i))
+                                          : luaV_lessequal(L, RB(i), &aux);
+    }
+    default: lua_assert(0); return 0;
+  }
+}
+
+
+static void jit_gettable (lua_State *L, CallInfo *ci, Instruction i, int pc) {
+  StkId base = ci->u.l.base;
+  LClosure *cl = clLvalue(ci->func);
+  TValue *k = cl->p->k;
+  StkId ra = base + GETARG_A(i);
+  const TValue *t;
+  const TValue *slot;
+  TValue *key;
+  TValue aux;
+  switch (GET_OPCODE(i)) {
+    case OP_GETTABUP: t = cl->upvals[GETARG_B(i)]->v; key = RKC(i); break;
+    case OP_GETFIELD: t = RB(i); key = k + GETARG_C(i); break;
+    case OP_GETI: t = RB(i); setivalue(&aux, GETARG_C(i)); key = &aux; break;
+    case OP_SELF: case OP_SELFCALL: {
+      StkId rb = RB(i);
+      setobjs2s(L, ra + 1, rb);
+      t = rb; key = RKC(i);
+      break;
+    }
+    default: lua_assert(GET_OPCODE(i) == OP_GETTABLE);
+      t = RB(i); key = RKC(i);
+      break;
+  }
+  if (ttisshrstring(key)
+      ? luaV_fastgetcached(L, t, tsvalue(key), slot, cl->p->icache + pc)
+      : luaV_fastget(L, t, key, slot, luaH_get)) {
+    setobj2s(L, ra, slot);
+  }
+  else luaV_finishget(L, t, key, ra, slot);
+}
+
+
+static void jit_settable (lua_State *L, CallInfo *ci, Instruction i, int pc) {
+  StkId base = ci->u.l.base;
+  LClosure *cl = clLvalue(ci->func);
+  TValue *k = cl->p->k;
+  const TValue *t;
+  UNUSED(pc);
+  if (GET_OPCODE(i) == OP_SETTABUP)
+    t = cl->upvals[GETARG_A(i)]->v;
+  else
+    t = base + GETARG_A(i);
+  luaV_settable(L, t, RKB(i), RKC(i));
+}
+
+
+static void jit_setupval (lua_State *L, CallInfo *ci, Instruction i, int pc) {
+  UpVal *uv = clLvalue(ci->func)->upvals[GETARG_B(i)];
+  UNUSED(pc);
+  setobj(L, uv->v, ci->u.l.base + GETARG_A(i));
+  luaC_upvalbarrier(L, uv);
+}
+
+
+static void jit_close (lua_State *L, CallInfo *ci, Instruction i, int pc) {
+  UNUSED(pc);
+  luaF_close(L, ci->u.l.base + GETARG_A(i) - 1);
+}
+
+/* }====================================================== */
+
+
+/* copy compiled code into executable memory */
+static JitCode *install (JitState *J) {
+  int n = J->p->sizecode;
+  size_t header = offsetof(JitCode, addr) + n * sizeof(unsigned char *);
+  size_t size;
+  unsigned char *block;
+  JitCode *jc;
+  int pc;
+  header = (header + 15) & ~cast(size_t, 15);  /* align code */
+  size = header + J->n;
+  block = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (block == MAP_FAILED)
+    return NULL;
+  jc = (JitCode *)block;
+  jc->size = size;
+  jc->entry = (JitFunction)(void *)(block + header);
+  for (pc = 0; pc < n; pc++)
+    jc->addr[pc] = block + header + J->label[pc];
+  memcpy(block + header, J->code, J->n);
+  if (mprotect(block, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(block, size);
+    return NULL;
+  }
+  G(J->L)->GCdebt += size;  /* (see LUAI_MAXJITCODE) */
+  return jc;
+}
+
+
+/*
+** generate the code for 'J->p'. A memory error in the buffers just
+** abandons the compilation (see 'luaJ_compile').
+*/
+static void compile (lua_State *L, void *ud) {
+  JitState *J = (JitState *)ud;
+  Proto *p = J->p;
+  int pc;
+  J->code = luaM_newvector(L, 256 + p->sizecode * 64, unsigned char);
+  J->size = 256 + p->sizecode * 64;
+  J->label = luaM_newvector(L, p->sizecode, size_t);
+  /* each instruction has at most 4 jumps to instructions */
+  J->fix = luaM_newvector(L, 4 * p->sizecode, JitFix);
+  prologue(J);
+  for (pc = 0; pc < p->sizecode; pc++) {
+    J->label[pc] = J->n;
+    instruction(J, luaP_genericinst(p->code[pc]), pc);
+  }
+  for (pc = 0; pc < J->nfix; pc++) {
+    int target = J->fix[pc].target;
+    lua_assert(0 <= target && target < p->sizecode);
+    patch(J, J->fix[pc].pos, J->label[target]);
+  }
+  p->jit = install(J);
+}
+
+
+void luaJ_compile (lua_State *L, Proto *p) {
+  JitState J;
+  lua_assert(p->jit == NULL);
+  if (!G(L)->jiton) {  /* compiler is off? */
+    p->jithot = G(L)->jitthreshold;  /* try again later */
+    return;
+  }
+  p->jithot = 0;  /* compile only once */
+  if (p->sizecode > LUAI_MAXJITCODE || TVSIZE != 16)
+    return;
+  J.L = L;
+  J.p = p;
+  J.code = NULL; J.size = 0; J.n = 0;
+  J.label = NULL;
+  J.fix = NULL; J.nfix = 0;
+  luaD_rawrunprotected(L, compile, &J);  /* (status is not needed) */
+  luaM_freearray(L, J.code, J.size);
+  if (J.label != NULL)
+    luaM_freearray(L, J.label, p->sizecode);
+  if (J.fix != NULL)
+    luaM_freearray(L, J.fix, 4 * p->sizecode);
+}
+
+
+void luaJ_run (lua_State *L, CallInfo *ci, Proto *p) {
+  JitCode *jc = p->jit;
+  jc->entry(L, ci, jc->addr[ci->u.l.savedpc - p->code]);
+}
+
+
+void luaJ_free (lua_State *L, Proto *p) {
+  if (p->jit != NULL) {
+    G(L)->GCdebt -= p->jit->size;
+    munmap(p->jit, p->jit->size);
+    p->jit = NULL;
+  }
+}
+
+#endif				/* } */
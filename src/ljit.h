@@ -0,0 +1,58 @@
+/*
+** $Id: ljit.h $
+** Baseline compiler from Lua bytecode to x86-64 machine code
+** See Copyright Notice in lua.h
+*/
+
+#ifndef ljit_h
+#define ljit_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** The compiler is optional: define LUA_USE_JIT (see the 'linux-jit'
+** target in the Makefile) to build it. Without it, all entry points
+** below become no-ops and 'Proto.jit' is always NULL.
+*/
+#if defined(LUA_USE_JIT) && !(defined(__x86_64__) && defined(__linux__))
+#error "LUA_USE_JIT is only supported on x86-64 Linux"
+#endif
+
+
+/* number of "hot" events (calls and loop iterations) before compiling */
+#if !defined(LUAI_JITTHRESHOLD)
+#define LUAI_JITTHRESHOLD	100
+#endif
+
+
+#if defined(LUA_USE_JIT)
+
+/*
+** count a hot event for prototype 'p', compiling it when its countdown
+** reaches zero ('jithot' stays at zero after an attempt to compile)
+*/
+#define luaJ_hot(L,p)  \
+  { if ((p)->jithot > 0 && --(p)->jithot == 0) luaJ_compile(L, p); }
+
+/* can the current frame (running 'p') run native code? */
+#define luaJ_canrun(L,p)  \
+  ((p)->jit != NULL && G(L)->jiton && \
+   !((L)->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)))
+
+LUAI_FUNC void luaJ_compile (lua_State *L, Proto *p);
+LUAI_FUNC void luaJ_run (lua_State *L, CallInfo *ci, Proto *p);
+LUAI_FUNC void luaJ_free (lua_State *L, Proto *p);
+
+#else
+
+#define luaJ_hot(L,p)		((void)0)
+#define luaJ_canrun(L,p)	0
+#define luaJ_compile(L,p)	((void)0)
+#define luaJ_run(L,ci,p)	((void)0)
+#define luaJ_free(L,p)		((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+/*
+** $Id: ljitlib.c $
+** Library to control the native compiler
+** See Copyright Notice in lua.h
+*/
+
+#define ljitlib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#if defined(LUA_USE_JIT)		/* { */
+
+
+static int jit_on (lua_State *L) {
+  lua_jit(L, LUA_JITON, 0);
+  return 0;
+}
+
+
+static int jit_off (lua_State *L) {
+  lua_jit(L, LUA_JITOFF, 0);
+  return 0;
+}
+
+
+static int jit_status (lua_State *L) {
+  lua_pushboolean(L, lua_jit(L, LUA_JITISON, 0));
+  return 1;
+}
+
+
+/*
+** jit.threshold([n]): set the number of calls and loop iterations
+** before a function is compiled; returns the previous value
+*/
+static int jit_threshold (lua_State *L) {
+  int previous;
+  if (lua_isnoneornil(L, 1)) {  /* only query it */
+    previous = lua_jit(L, LUA_JITSETTHRESHOLD, 1);
+    lua_jit(L, LUA_JITSETTHRESHOLD, previous);
+  }
+  else {
+    int n = (int)luaL_checkinteger(L, 1);
+    luaL_argcheck(L, n > 0, 1, "must be positive");
+    previous = lua_jit(L, LUA_JITSETTHRESHOLD, n);
+  }
+  lua_pushinteger(L, previous);
+  return 1;
+}
+
+
+/* jit.compile(f): compile Lua function 'f' now; returns success */
+static int jit_compile (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  lua_pushboolean(L, lua_jit(L, LUA_JITCOMPILE, 1) == 1);
+  return 1;
+}
+
+
+static const luaL_Reg jitlib[] = {
+  {"compile", jit_compile},
+  {"off", jit_off},
+  {"on", jit_on},
+  {"status", jit_status},
+  {"threshold", jit_threshold},
+  {NULL, NULL}
+};
+
+
+
+LUAMOD_API int luaopen_jit (lua_State *L) {
+  luaL_newlib(L, jitlib);
+  return 1;
+}
+
+
+#else					/* }{ */
+
+
+LUAMOD_API int luaopen_jit (lua_State *L) {
+  return luaL_error(L, "library 'jit' not available (build with LUA_USE_JIT)");
+}
+
+#endif					/* } */
@@ -136,7 +136,8 @@ TString *luaX_newstring (LexState *ls, const char *str, size_t l) {
     setbvalue(o, 1);  /* t[string] = true */
     luaC_checkGC(L);
   }
-  else {  /* string already present */
+  else if (!isshaped(ls->h)) {  /* string already present */
+    /* (keys of shaped tables are short strings, which are unique) */
     ts = tsvalue(keyfromval(o));  /* re-use value previously stored */
   }
   L->top--;  /* remove string from stack */
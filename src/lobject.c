@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <float.h>
 #include <locale.h>
 #include <math.h>
 #include <stdarg.h>
@@ -446,6 +447,225 @@ int luaO_utf8esc (char *buff, unsigned long x) {
 #define MAXNUMBER2STR	50
 
 
+/*
+** {==================================================================
+** Conversion of numbers to strings
+** ===================================================================
+*/
+
+/* pairs of decimal digits */
+static const char digitpairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233"
+  "34353637383940414243444546474849505152535455565758596061626364656667"
+  "6869707172737475767778798081828384858687888990919293949596979899";
+
+
+/*
+** Writes the decimal digits of 'u' backwards, two at a time, ending
+** at 'e'. Returns where they start.
+*/
+static char *utodec (char *e, lua_Unsigned u) {
+  while (u >= 100) {
+    unsigned int d = cast(unsigned int, u % 100);
+    u /= 100;
+    e -= 2;
+    memcpy(e, digitpairs + 2 * d, 2);
+  }
+  if (u >= 10) {
+    e -= 2;
+    memcpy(e, digitpairs + 2 * u, 2);
+  }
+  else
+    *--e = cast(char, '0' + u);
+  return e;
+}
+
+
+static int int2str (char *buff, lua_Integer i) {
+  char temp[MAXNUMBER2STR];
+  char *e = temp + sizeof(temp);
+  char *s = utodec(e, (i < 0) ? 0u - l_castS2U(i) : l_castS2U(i));
+  if (i < 0)
+    *--s = '-';
+  memcpy(buff, s, e - s);
+  return cast_int(e - s);
+}
+
+
+/*
+** Floats are converted without 'lua_number2str' when their digits can
+** be computed exactly from a single multiplication or division by a
+** power of 10. That needs doubles (with LUAI_NUMDIGITS telling the
+** precision of LUA_NUMBER_FMT) and integers wide enough for the digits.
+*/
+#if defined(LUAI_NUMDIGITS) && (LUA_MAXINTEGER >> 52) > 0	/* { */
+
+/* maximum number of digits computed by 'decdigits' */
+#define MAXDECDIGITS	15
+
+/* powers of 10 that are exact doubles */
+static const lua_Number powers10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+  1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAXPOWER10	22
+
+
+/*
+** Computes the first 'p' significant decimal digits of 'x' (positive
+** and finite) as an integer '*u' with 'p' digits, rounded as 'printf'
+** would, and the decimal exponent '*e' of the first digit. 'x' scaled
+** by 10^(p - 1 - *e) has only the error of its last rounding, so its
+** rounding to an integer is sure unless it is too close to a tie; then
+** (or when the power is too large) returns 0.
+*/
+static int decdigits (lua_Number x, int p, lua_Unsigned *u, int *e) {
+  lua_Number y, f, d;
+  int b, k, tries;
+  l_mathop(frexp)(x, &b);
+  *e = cast_int(l_floor((b - 1) * 0.30102999566398119521));  /* log10 */
+  for (tries = 0; ; tries++) {  /* that estimate may be one off */
+    k = p - 1 - *e;
+    if (tries > 2 || k < -MAXPOWER10 || k > MAXPOWER10)
+      return 0;
+    y = (k >= 0) ? x * powers10[k] : x / powers10[-k];
+    if (y < powers10[p - 1]) (*e)--;
+    else if (y >= powers10[p]) (*e)++;
+    else break;
+  }
+  f = l_floor(y);
+  d = y - f - 0.5;
+  if (l_mathop(fabs)(d) <= y * l_mathlim(EPSILON))
+    return 0;  /* too close to a tie */
+  *u = cast(lua_Unsigned, f) + (d > 0);
+  if (*u == cast(lua_Unsigned, powers10[p])) {  /* rounded up to 10^p? */
+    *u /= 10;
+    (*e)++;
+  }
+  return 1;
+}
+
+
+/*
+** Writes the float with the 'p' digits 'u' and exponent 'e' as format
+** '%.<p>g' would: without trailing zeros, in fixed notation unless the
+** exponent is less than -4 or not less than 'p'.
+*/
+static int fmtdigits (char *buff, int neg, lua_Unsigned u, int e, int p) {
+  char temp[MAXNUMBER2STR];
+  const char point = lua_getlocaledecpoint();
+  char *b = buff;
+  const char *s = utodec(temp + sizeof(temp), u);
+  int nd = p;  /* number of significant digits */
+  while (nd > 1 && s[nd - 1] == '0') nd--;  /* remove trailing zeros */
+  if (neg) *b++ = '-';
+  if (e < -4 || e >= p) {  /* exponential format */
+    int ae = (e < 0) ? -e : e;
+    char *es;
+    *b++ = s[0];
+    if (nd > 1) {
+      *b++ = point;
+      memcpy(b, s + 1, nd - 1);
+      b += nd - 1;
+    }
+    *b++ = 'e';
+    *b++ = (e < 0) ? '-' : '+';
+    if (ae < 10) *b++ = '0';  /* at least two digits */
+    es = utodec(temp + sizeof(temp), cast(lua_Unsigned, ae));
+    memcpy(b, es, (temp + sizeof(temp)) - es);
+    b += (temp + sizeof(temp)) - es;
+  }
+  else if (e < 0) {  /* 0.00ddd */
+    *b++ = '0';
+    *b++ = point;
+    memset(b, '0', -e - 1);
+    b += -e - 1;
+    memcpy(b, s, nd);
+    b += nd;
+  }
+  else if (nd <= e + 1) {  /* integral value */
+    memcpy(b, s, nd);
+    memset(b + nd, '0', e + 1 - nd);
+    b += e + 1;
+  }
+  else {  /* ddd.ddd */
+    memcpy(b, s, e + 1);
+    b += e + 1;
+    *b++ = point;
+    memcpy(b, s + e + 1, nd - e - 1);
+    b += nd - e - 1;
+  }
+  return cast_int(b - buff);
+}
+
+
+static int flt2str (char *buff, lua_Number x) {
+  int neg = (x < 0 || (x == 0 && 1 / x < 0));  /* (-0.0 is negative) */
+  lua_Number a = l_mathop(fabs)(x);
+  lua_Unsigned u;
+  int e;
+  int p = LUAI_NUMDIGITS;
+  if (a == 0)
+    return fmtdigits(buff, neg, 0, 0, 1);
+  else if (!(a <= l_mathlim(MAX)))  /* inf or nan? */
+    return lua_number2str(buff, MAXNUMBER2STR, x);
+#if defined(LUA_FLOAT_SHORTEST)
+  /* try precisions until the result reads back as 'x' (a precision
+     below LUAI_NUMDIGITS that reads back gives the same string) */
+  for (; p <= MAXDECDIGITS; p++) {
+    if (!decdigits(a, p, &u, &e))
+      break;  /* go the slow way from this precision */
+    else if ((e - p + 1 >= 0) ? cast_num(u) * powers10[e - p + 1] == a
+                              : cast_num(u) / powers10[p - 1 - e] == a)
+      return fmtdigits(buff, neg, u, e, p);
+  }
+  for (; ; p++) {  /* 17 digits always read back */
+    char form[16];  /* format '%.<p>g' */
+    int len;
+    l_sprintf(form, sizeof(form), "%%.%d" LUA_NUMBER_FRMLEN "g", p);
+    len = l_sprintf(buff, MAXNUMBER2STR, form, (LUAI_UACNUMBER)x);
+    if (p >= 17 || lua_str2number(buff, NULL) == x)
+      return len;
+  }
+#else
+  if (decdigits(a, p, &u, &e))
+    return fmtdigits(buff, neg, u, e, p);
+  return lua_number2str(buff, MAXNUMBER2STR, x);
+#endif
+}
+
+#else						/* }{ */
+
+#define flt2str(buff,x)		lua_number2str(buff, MAXNUMBER2STR, x)
+
+#endif						/* } */
+
+
+/*
+** Convert a number object to a string, returning its length
+*/
+static int tostringbuff (TValue *obj, char *buff) {
+  int len;
+  lua_assert(ttisnumber(obj));
+  if (ttisinteger(obj))
+    len = int2str(buff, ivalue(obj));
+  else {
+    len = flt2str(buff, fltvalue(obj));
+#if !defined(LUA_COMPAT_FLOATSTRING)
+    buff[len] = '\0';
+    if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
+      buff[len++] = lua_getlocaledecpoint();
+      buff[len++] = '0';  /* adds '.0' to result */
+    }
+#endif
+  }
+  return len;
+}
+
+/* }================================================================== */
+
+
 /*
 ** Convert a number object to a string
 */
@@ -462,19 +682,7 @@ int luaO_utf8esc (char *buff, unsigned long x) {
 // 然后调用setsvalue2s创建一个LUA_TSTRING类型的TValue压入栈中
 void luaO_tostring (lua_State *L, StkId obj) {
   char buff[MAXNUMBER2STR];
-  size_t len;
-  lua_assert(ttisnumber(obj));
-  if (ttisinteger(obj))
-    len = lua_integer2str(buff, sizeof(buff), ivalue(obj));
-  else {
-    len = lua_number2str(buff, sizeof(buff), fltvalue(obj));
-#if !defined(LUA_COMPAT_FLOATSTRING)
-    if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
-      buff[len++] = lua_getlocaledecpoint();
-      buff[len++] = '0';  /* adds '.0' to result */
-    }
-#endif
-  }
+  int len = tostringbuff(obj, buff);
   setsvalue2s(L, obj, luaS_newlstr(L, buff, len));
 }
 
@@ -569,6 +777,8 @@ const char *luaO_pushvfstring (lua_State *L, const char *fmt, va_list argp) {
   luaD_checkstack(L, 1);
   pushstr(L, fmt, strlen(fmt));
   if (n > 0) luaV_concat(L, n + 1);
+  if (ttislngstring(L->top - 1))
+    luaS_flatten(L, tsvalue(L->top - 1), 1);  /* caller keeps its bytes */
   return svalue(L->top - 1);
 }
 
@@ -24,6 +24,7 @@
 #define LUA_TPROTO	LUA_NUMTAGS		/* function prototypes */
 // LUA_TDEADKEY用来标记lua数据的上限tag
 #define LUA_TDEADKEY	(LUA_NUMTAGS+1)		/* removed keys in tables */
+#define LUA_TSHAPE	(LUA_NUMTAGS+2)		/* table shapes (see ltable.c) */
 
 /*
 ** number of all possible tags (including LUA_TNONE but excluding DEADKEY)
@@ -156,8 +157,7 @@ typedef struct lua_TValue {
 
 // 获取TValue的tt_部分
 /* raw type tag of a TValue */
-#define 
-rttype(o)	((o)->tt_)
+#define rttype(o)	((o)->tt_)
 
 // 用来获取tag的后四位
 /* tag with no variants (bits 0-3) */
@@ -381,13 +381,62 @@ typedef union UTString {
 } UTString;
 
 
+/*
+** Buffer holding the bytes of long strings built by concatenation
+** (see 'luaS_extend'). Each such string uses its first 'lnglen' bytes.
+** A string using all bytes in use may get new ones appended.
+*/
+typedef struct StrBuf {
+  size_t refs;  /* number of strings using this buffer */
+  size_t used;  /* number of bytes in use (followed by a '\0') */
+  size_t size;  /* number of bytes allocated for 'data' (plus 1) */
+  lu_byte sealed;  /* true if no more bytes may be appended */
+  char data[1];
+} StrBuf;
+
+
+/*
+** Long strings whose bytes do not follow their header have, instead,
+** a 'StrRef' after it, and one of these marks in their 'shrlen':
+** BUFSTR for bytes in a 'StrBuf'; EXTSTR for bytes owned by the host
+** (see 'lua_pushexternalstring').
+*/
+typedef struct StrRef {
+  char *data;  /* the bytes */
+  union {
+    StrBuf *b;  /* buffer holding them (BUFSTR) */
+    struct {  /* how to release them (EXTSTR) */
+      lua_Alloc f;
+      void *ud;
+    } ext;
+  } u;
+} StrRef;
+
+#define EXTSTR		cast_byte(254)	/* (greater than LUAI_MAXSHORTLEN) */
+#define BUFSTR		cast_byte(255)
+
+#define isrefstr(ts)	((ts)->shrlen >= EXTSTR)
+#define isextstr(ts)	((ts)->shrlen == EXTSTR)
+#define isbufstr(ts)	((ts)->shrlen == BUFSTR)
+#define strref(ts)	cast(StrRef *, cast(char *, (ts)) + sizeof(UTString))
+#define strbuf(ts)	(strref(ts)->u.b)
+
+
 /*
 ** Get the actual string (array of bytes) from a 'TString'.
 ** (Access to 'extra' ensures that value is really a 'TString'.)
 */
 // 获得实际的字符串（也就是上面的结构体）
 #define getstr(ts)  \
-  check_exp(sizeof((ts)->extra), cast(char *, (ts)) + sizeof(UTString))
+  check_exp(sizeof((ts)->extra), \
+    isrefstr(ts) ? strref(ts)->data : rawgetstr(ts))
+
+/*
+** Bytes that follow the header, as those of short strings and of new
+** long strings do; these accesses need not test for a 'StrRef'.
+*/
+#define rawgetstr(ts)	(cast(char *, (ts)) + sizeof(UTString))
+#define getshrstr(ts)	check_exp((ts)->tt == LUA_TSHRSTR, rawgetstr(ts))
 
 
 /* get the actual string (array of bytes) from a Lua value */
@@ -511,6 +560,8 @@ typedef struct Proto {
   int sizelineinfo;
   int sizep;  /* size of 'p' */
   int sizelocvars;
+  int sizeicache;  /* size of 'icache' */
+  int jithot;  /* countdown to native compilation (see ljit.c) */
   int linedefined;  /* debug information  */
   int lastlinedefined;  /* debug information  */
   TValue *k;  /* constants used by the function */
@@ -519,6 +570,8 @@ typedef struct Proto {
   int *lineinfo;  /* map from opcodes to source lines (debug information) */
   LocVar *locvars;  /* information about local variables (debug information) */
   Upvaldesc *upvalues;  /* upvalue information */
+  unsigned int *icache;  /* inline caches, one per instruction */
+  struct JitCode *jit;  /* native code (NULL if not compiled) */
   struct LClosure *cache;  /* last-created closure with this prototype */
   TString  *source;  /* used for debug information */
   GCObject *gclist;
@@ -613,15 +666,47 @@ typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
   lu_byte lsizenode;  /* log2 of size of 'node' array */
+  lu_byte sizefields;  /* size of 'fields' array */
+  lu_byte arraytype;  /* type of raw values in 'array' (LUA_TNIL if boxed) */
+  lu_byte lsizeold;  /* log2 of size of 'oldnode' array */
+  lu_byte status;  /* FROZENBIT, PLAINBIT, DIRTYBIT (see ltable.h) */
   unsigned int sizearray;  /* size of 'array' array */
+  unsigned int nraw;  /* number of raw values in use (if unboxed) */
   TValue *array;  /* array part */
   Node *node;
   Node *lastfree;  /* any free position is before this position */
+  Node *oldnode;  /* hash part being migrated into 'node' (or NULL) */
+  unsigned int oldpos;  /* nodes of 'oldnode' still to be migrated */
+  unsigned int lenhint;  /* last boundary found by 'luaH_getn' */
+  struct Shape *shape;  /* key layout of 'fields' (NULL if hashed) */
+  TValue *fields;  /* values of the keys in 'shape' */
   struct Table *metatable;
   GCObject *gclist;
 } Table;
 
 
+/*
+** Shapes (hidden classes). A table whose keys are all short strings
+** keeps them in a shape shared by all tables that got the same keys
+** in the same order, and keeps only the values, in 'fields': the value
+** of key 'keys[i]' lives in 'fields[i]'. Each shape repeats the keys of
+** its ancestors, so a search never walks the 'parent' chain; shapes
+** with many keys are followed by an open-addressing 'index' from a key
+** hash to its position in 'keys' (see 'shapeindex' in ltable.h). The
+** shapes derived from a given one ('child' and its 'sibling's) are
+** weak references, used only to find an existing transition.
+*/
+typedef struct Shape {
+  CommonHeader;
+  lu_byte nkeys;  /* number of keys */
+  lu_byte lsizeindex;  /* log2 of size of 'index' */
+  struct Shape *parent;  /* shape without the last key */
+  struct Shape *child;  /* list of shapes derived from this one */
+  struct Shape *sibling;  /* next shape in parent's 'child' list */
+  TString *keys[1];  /* keys (followed by 'index') */
+} Shape;
+
+
 
 /*
 ** 'module' operation for hashing (size is always a power of 2)
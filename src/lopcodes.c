@@ -65,6 +65,22 @@ LUAI_DDEF const char *const luaP_opnames[NUM_OPCODES+1] = {
   "CLOSURE",
   "VARARG",
   "EXTRAARG",
+  "GETI",
+  "GETFIELD",
+  "ADDI",
+  "SUBI",
+  "EQI",
+  "LTI",
+  "LEI",
+  "SELFCALL",
+  "ADDII",
+  "SUBII",
+  "MULII",
+  "ADDFF",
+  "SUBFF",
+  "MULFF",
+  "LTII",
+  "LEII",
   NULL
 };
 
@@ -120,5 +136,37 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, OpArgU, OpArgN, iABx)		/* OP_CLOSURE */
  ,opmode(0, 1, OpArgU, OpArgN, iABC)		/* OP_VARARG */
  ,opmode(0, 0, OpArgU, OpArgU, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 1, OpArgR, OpArgU, iABC)		/* OP_GETI */
+ ,opmode(0, 1, OpArgR, OpArgU, iABC)		/* OP_GETFIELD */
+ ,opmode(0, 1, OpArgR, OpArgU, iABC)		/* OP_ADDI */
+ ,opmode(0, 1, OpArgR, OpArgU, iABC)		/* OP_SUBI */
+ ,opmode(1, 0, OpArgR, OpArgU, iABC)		/* OP_EQI */
+ ,opmode(1, 0, OpArgR, OpArgU, iABC)		/* OP_LTI */
+ ,opmode(1, 0, OpArgR, OpArgU, iABC)		/* OP_LEI */
+ ,opmode(0, 1, OpArgR, OpArgK, iABC)		/* OP_SELFCALL */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUBII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_MULII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDFF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUBFF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_MULFF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTII */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LEII */
 };
 
+
+/*
+** undo the quickening of an instruction (see 'luaV_execute')
+*/
+Instruction luaP_genericinst (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_ADDII: case OP_ADDFF: SET_OPCODE(i, OP_ADD); break;
+    case OP_SUBII: case OP_SUBFF: SET_OPCODE(i, OP_SUB); break;
+    case OP_MULII: case OP_MULFF: SET_OPCODE(i, OP_MUL); break;
+    case OP_LTII: SET_OPCODE(i, OP_LT); break;
+    case OP_LEII: SET_OPCODE(i, OP_LE); break;
+    default: lua_assert(GET_OPCODE(i) < OP_FIRSTQUICK); break;
+  }
+  return i;
+}
+
@@ -20,6 +20,7 @@
 	'Ax' : 26 bits ('A', 'B', and 'C' together)
 	'Bx' : 18 bits ('B' and 'C' together)
 	'sBx' : signed Bx
+	'sC' : signed C
 
   A signed argument is represented in excess K; that is, the number
   value is the unsigned value minus K. K is exactly the maximum value
@@ -88,6 +89,7 @@ enum OpMode {iABC, iABx, iAsBx, iAx};  /* basic instruction format */
 #define MAXARG_A        ((1<<SIZE_A)-1)
 #define MAXARG_B        ((1<<SIZE_B)-1)
 #define MAXARG_C        ((1<<SIZE_C)-1)
+#define MAXARG_sC       (MAXARG_C>>1)         /* 'sC' is signed */
 
 
 /* creates a mask with 'n' 1 bits at position 'p' */
@@ -126,6 +128,9 @@ enum OpMode {iABC, iABx, iAsBx, iAx};  /* basic instruction format */
 #define GETARG_sBx(i)	(GETARG_Bx(i)-MAXARG_sBx)
 #define SETARG_sBx(i,b)	SETARG_Bx((i),cast(unsigned int, (b)+MAXARG_sBx))
 
+#define GETARG_sC(i)	(GETARG_C(i)-MAXARG_sC)
+#define int2sC(i)	((i)+MAXARG_sC)
+
 
 #define CREATE_ABC(o,a,b,c)	((cast(Instruction, o)<<POS_OP) \
 			| (cast(Instruction, a)<<POS_A) \
@@ -161,6 +166,13 @@ enum OpMode {iABC, iABx, iAsBx, iAx};  /* basic instruction format */
 #define RKASK(x)	((x) | BITRK)
 
 
+/*
+** in OP_LTI and OP_LEI, this bit of argument A means that the immediate
+** is the first operand (the lowest bit of A is the condition)
+*/
+#define BITIMMFIRST	2
+
+
 /*
 ** invalid register that fits in 8 bits
 */
@@ -171,6 +183,7 @@ enum OpMode {iABC, iABx, iAsBx, iAx};  /* basic instruction format */
 ** R(x) - register
 ** Kst(x) - constant (in constant table)
 ** RK(x) == if ISK(x) then Kst(INDEXK(x)) else R(x)
+** sC - signed integer immediate (in the C argument)
 */
 
 
@@ -244,11 +257,36 @@ OP_CLOSURE,/*	A Bx	R(A) := closure(KPROTO[Bx])			*/
 
 OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-2) = vararg		*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+OP_GETI,/*	A B C	R(A) := R(B)[C]					*/
+OP_GETFIELD,/*	A B C	R(A) := R(B)[Kst(C)]	(Kst(C) is a short string)	*/
+
+OP_ADDI,/*	A B sC	R(A) := R(B) + sC				*/
+OP_SUBI,/*	A B sC	R(A) := R(B) - sC				*/
+
+OP_EQI,/*	A B sC	if ((R(B) == sC) ~= A) then pc++		*/
+OP_LTI,/*	A B sC	if ((R(B) <  sC) ~= A) then pc++	(see note)	*/
+OP_LEI,/*	A B sC	if ((R(B) <= sC) ~= A) then pc++	(see note)	*/
+
+OP_SELFCALL,/*	A B C	OP_SELF followed by its OP_CALL	(see note)	*/
+
+/* quickened variants, created only by the interpreter (see notes) */
+OP_ADDII,/*	A B C	R(A) := RK(B) + RK(C)	(integers)		*/
+OP_SUBII,/*	A B C	R(A) := RK(B) - RK(C)	(integers)		*/
+OP_MULII,/*	A B C	R(A) := RK(B) * RK(C)	(integers)		*/
+OP_ADDFF,/*	A B C	R(A) := RK(B) + RK(C)	(floats)		*/
+OP_SUBFF,/*	A B C	R(A) := RK(B) - RK(C)	(floats)		*/
+OP_MULFF,/*	A B C	R(A) := RK(B) * RK(C)	(floats)		*/
+OP_LTII,/*	A B C	if ((RK(B) <  RK(C)) ~= A) then pc++ (integers)	*/
+OP_LEII/*	A B C	if ((RK(B) <= RK(C)) ~= A) then pc++ (integers)	*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_EXTRAARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_LEII) + 1)
+
+/* opcodes from this one on are quickened variants */
+#define OP_FIRSTQUICK	OP_ADDII
 
 
 
@@ -269,10 +307,23 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
   (*) In OP_LOADKX, the next 'instruction' is always EXTRAARG.
 
   (*) For comparisons, A specifies what condition the test should accept
-  (true or false).
+  (true or false). In OP_LTI and OP_LEI, if A has the BITIMMFIRST bit
+  the operands are swapped ('sC < R(B)' and 'sC <= R(B)').
 
   (*) All 'skips' (pc++) assume that next instruction is a jump.
 
+  (*) OP_SELFCALL is a superinstruction created by 'luaK_finish': an
+  OP_SELF whose next instruction is the OP_CALL that uses its result
+  (a method call without arguments). It does the OP_SELF and then the
+  OP_CALL without a new dispatch; the OP_CALL stays in the code, so
+  jumps and debug information are not affected.
+
+  (*) Quickened opcodes (OP_ADDII...OP_LEII) replace, at run time, a
+  generic instruction whose operands had the given types; they behave
+  exactly like the generic one, which they turn back into when their
+  operands have other types. They never appear in code generated by
+  the parser or in precompiled chunks.
+
 ===========================================================================*/
 
 
@@ -303,6 +354,8 @@ LUAI_DDEC const lu_byte luaP_opmodes[NUM_OPCODES];
 
 LUAI_DDEC const char *const luaP_opnames[NUM_OPCODES+1];  /* opcode names */
 
+LUAI_FUNC Instruction luaP_genericinst (Instruction i);
+
 
 /* number of list items to accumulate before a SETLIST instruction */
 #define LFIELDS_PER_FLUSH	50
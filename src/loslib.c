@@ -382,6 +382,24 @@ static int os_difftime (lua_State *L) {
 /* }====================================================== */
 
 
+/*
+** Clears the table of compiled patterns of the string library (see
+** 'getpattern' in lstrlib.c)
+*/
+static void clearpatterns (lua_State *L) {
+  if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_PATTERNS_TABLE) == LUA_TTABLE) {
+    lua_pushnil(L);  /* first key */
+    while (lua_next(L, -2)) {
+      lua_pop(L, 1);  /* remove value */
+      lua_pushvalue(L, -1);  /* key */
+      lua_pushnil(L);
+      lua_rawset(L, -4);  /* table[key] = nil */
+    }
+  }
+  lua_pop(L, 1);  /* remove table */
+}
+
+
 static int os_setlocale (lua_State *L) {
   static const int cat[] = {LC_ALL, LC_COLLATE, LC_CTYPE, LC_MONETARY,
                       LC_NUMERIC, LC_TIME};
@@ -390,6 +408,8 @@ static int os_setlocale (lua_State *L) {
   const char *l = luaL_optstring(L, 1, NULL);
   int op = luaL_checkoption(L, 2, "all", catnames);
   lua_pushstring(L, setlocale(cat[op], l));
+  if (l != NULL)  /* classes in compiled patterns may have changed */
+    clearpatterns(L);
   return 1;
 }
 
@@ -20,6 +20,7 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "llex.h"
 #include "lmem.h"
 #include "lstate.h"
@@ -229,6 +230,7 @@ static void f_luaopen (lua_State *L, void *ud) {
   global_State *g = G(L);
   UNUSED(ud);
   stack_init(L, L);  /* init stack */
+  luaH_init(L);
   init_registry(L, g);
   luaS_init(L);
   luaT_init(L);
@@ -277,6 +279,8 @@ static void close_state (lua_State *L) {
   luaC_freeallobjects(L);  /* collect all objects */
   if (g->version)  /* closing a fully built state? */
     luai_userstateclose(L);
+  if (G(L)->strt.oldhash != NULL)  /* string table being resized? */
+    luaS_migrate(L, G(L)->strt.oldpos);  /* finish it */
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
   freestack(L);
   lua_assert(gettotalbytes(g) == sizeof(LG));
@@ -367,9 +371,12 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->GCestimate = 0;
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
+  g->strt.oldhash = NULL;
+  g->strt.oldsize = g->strt.oldpos = 0;
   setnilvalue(&g->l_registry);
   g->panic = NULL;
   g->version = NULL;
+  g->emptyshape = NULL;
   g->gcstate = GCSpause;
   g->gckind = KGC_NORMAL;
   g->allgc = g->finobj = g->tobefnz = g->fixedgc = NULL;
@@ -382,6 +389,8 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gcfinnum = 0;
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
+  g->jiton = 1;
+  g->jitthreshold = LUAI_JITTHRESHOLD;
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;  /*设置9种数据类型的元表*/
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
     /* memory allocation error: free partial state */
@@ -77,6 +77,9 @@ typedef struct stringtable {
   TString **hash;
   int nuse;  /* number of elements */
   int size;
+  TString **oldhash;  /* previous vector, while being migrated (or NULL) */
+  int oldsize;
+  int oldpos;  /* buckets of 'oldhash' still to be migrated */
 } stringtable;
 
 
@@ -240,12 +243,15 @@ typedef struct global_State {
   GCObject *fixedgc;  /* list of objects not to be collected */
   struct lua_State *twups;  /* list of threads with open upvalues */
   unsigned int gcfinnum;  /* number of finalizers to call in each GC step */
+  lu_byte jiton;  /* true if native compilation is enabled */
+  int jitthreshold;  /* hot events before compiling a function */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC 'granularity' */ 
   lua_CFunction panic;  /* to be called in unprotected errors */
   struct lua_State *mainthread;
   const lua_Number *version;  /* pointer to version number */
   TString *memerrmsg;  /* memory-error message */
+  struct Shape *emptyshape;  /* shape of new tables (root of all shapes) */
   TString *tmname[TM_N];  /* array with tag-method names */
   struct Table *mt[LUA_NUMTAGS];  /* metatables for basic types */
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
@@ -325,6 +331,7 @@ union GCUnion {
   union Closure cl;
   struct Table h;
   struct Proto p;
+  struct Shape sh;
   struct lua_State th;  /* thread */
 };
 
@@ -353,12 +360,14 @@ union GCUnion {
 #define gco2t(o)  check_exp((o)->tt == LUA_TTABLE, &((cast_u(o))->h))
 #define gco2p(o)  check_exp((o)->tt == LUA_TPROTO, &((cast_u(o))->p))
 #define gco2th(o)  check_exp((o)->tt == LUA_TTHREAD, &((cast_u(o))->th))
+#define gco2shape(o)  check_exp((o)->tt == LUA_TSHAPE, &((cast_u(o))->sh))
 
 
 /* macro to convert a Lua object into a GCObject */
   // 把一个lua对象转换成GCObject对象的宏
 #define obj2gco(v) \
-	check_exp(novariant((v)->tt) < LUA_TDEADKEY, (&(cast_u(v)->gc)))
+	check_exp(novariant((v)->tt) < LUA_TDEADKEY || (v)->tt == LUA_TSHAPE, \
+	          (&(cast_u(v)->gc)))
 
 
 /* actual number of total bytes allocated */
@@ -21,6 +21,37 @@
                                  (sizeof(s)/sizeof(char))-1))
 
 
+/*
+** Large string tables are not rehashed in one go, which would stall the
+** program for a time proportional to the number of strings. Instead,
+** 'luaS_resize' keeps the old vector of buckets aside, and each new
+** string (and each basic GC step) moves LUAI_STRMIGRATESTEP of its
+** buckets into the new vector (see 'luaS_migrate'). Until then,
+** searches look in both. Vectors with less than LUAI_STRMIGRATESIZE buckets move at once.
+*/
+#if !defined(LUAI_STRMIGRATESIZE)
+#define LUAI_STRMIGRATESIZE	(1 << 12)
+#endif
+
+#if !defined(LUAI_STRMIGRATESTEP)
+#define LUAI_STRMIGRATESTEP	8
+#endif
+
+
+/*
+** Concatenations whose first operand is a long string with at least
+** LUAI_MINBUFSTR bytes build their result in a growable buffer (see
+** 'luaS_extend').
+*/
+#if !defined(LUAI_MINBUFSTR)
+#define LUAI_MINBUFSTR		256
+#endif
+
+/* size of the object of long string 'ts' */
+#define sizelngstr(ts)  \
+	sizelstring(isrefstr(ts) ? sizeof(StrRef) : (ts)->u.lnglen)
+
+
 /*
 ** test whether a string is a reserved word
 */
@@ -37,6 +68,7 @@ LUAI_FUNC unsigned int luaS_hash (const char *str, size_t l, unsigned int seed);
 LUAI_FUNC unsigned int luaS_hashlongstr (TString *ts);
 LUAI_FUNC int luaS_eqlngstr (TString *a, TString *b);
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
+LUAI_FUNC void luaS_migrate (lua_State *L, int n);
 LUAI_FUNC void luaS_clearcache (global_State *g);
 LUAI_FUNC void luaS_init (lua_State *L);
 LUAI_FUNC void luaS_remove (lua_State *L, TString *ts);
@@ -44,6 +76,12 @@ LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
 LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
 LUAI_FUNC TString *luaS_createlngstrobj (lua_State *L, size_t l);
+LUAI_FUNC TString *luaS_newext (lua_State *L, const char *s, size_t l,
+                                 lua_Alloc f, void *ud);
+LUAI_FUNC void luaS_freeext (TString *ts);
+LUAI_FUNC TString *luaS_extend (lua_State *L, TString *prefix, size_t l);
+LUAI_FUNC void luaS_flatten (lua_State *L, TString *ts, int seal);
+LUAI_FUNC void luaS_releasebuf (lua_State *L, StrBuf *b);
 
 
 #endif
@@ -14,11 +14,16 @@
 #include <float.h>
 #include <limits.h>
 #include <locale.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "lua.h"
 
 #include "lauxlib.h"
@@ -112,12 +117,120 @@ static int str_sub (lua_State *L) {
 */
 
 
+/*
+** {======================================================
+** BYTE KERNELS
+** =======================================================
+*/
+
+#if defined(__GNUC__)
+#define lowbit(x)	__builtin_ctz(x)
+#else
+static int lowbit (unsigned int x) {
+  int i = 0;
+  while (!(x & 1u)) { x >>= 1; i++; }
+  return i;
+}
+#endif
+
+
+#if defined(__SSE2__)
+
+/*
+** Checks whether the current locale maps the ASCII characters as the
+** C locale does ('A'-'Z' to 'a'-'z' and the others to themselves), so
+** that ASCII text may be converted without 'tolower'/'toupper'. The
+** answer is kept with the compiled patterns (first upvalue of the
+** library functions), which 'os.setlocale' clears.
+*/
+static int asciicase (lua_State *L) {
+  static const char key = 'k';  /* (its address is the key) */
+  int res;
+  if (lua_rawgetp(L, lua_upvalueindex(1), &key) == LUA_TNIL) {
+    int c;
+    res = 1;
+    for (c = 0; c < 0x80 && res; c++) {
+      int up = ('a' <= c && c <= 'z') ? c - ('a' - 'A') : c;
+      int low = ('A' <= c && c <= 'Z') ? c + ('a' - 'A') : c;
+      res = (toupper(c) == up && tolower(c) == low);
+    }
+    lua_pushboolean(L, res);
+    lua_rawsetp(L, lua_upvalueindex(1), &key);
+  }
+  else
+    res = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  return res;
+}
+
+#endif
+
+
+/*
+** Converts the 'l' bytes at 's' into 'p' with 'conv' ('tolower' or
+** 'toupper'). With SSE2, if the locale allows it, 16 bytes are handled
+** at a time when they are all ASCII: those in the range 'first'-'last'
+** get 'delta' added.
+*/
+static void convcase (lua_State *L, char *p, const char *s, size_t l,
+                      int (*conv) (int), int first, int last, int delta) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  if (l >= 16 && asciicase(L)) {
+    const __m128i lo = _mm_set1_epi8((char)(first - 1));
+    const __m128i hi = _mm_set1_epi8((char)(last + 1));
+    const __m128i d = _mm_set1_epi8((char)delta);
+    for (; l - i >= 16; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+      if (_mm_movemask_epi8(x) == 0) {  /* all ASCII? (so signed is ok) */
+        __m128i in = _mm_and_si128(_mm_cmpgt_epi8(x, lo),
+                                   _mm_cmplt_epi8(x, hi));
+        _mm_storeu_si128((__m128i *)(p + i),
+                         _mm_add_epi8(x, _mm_and_si128(in, d)));
+      }
+      else {
+        size_t j;
+        for (j = i; j < i + 16; j++)
+          p[j] = (char)conv(uchar(s[j]));
+      }
+    }
+  }
+#else
+  (void)L; (void)first; (void)last; (void)delta;  /* not used */
+#endif
+  for (; i < l; i++)
+    p[i] = (char)conv(uchar(s[i]));
+}
+
+
+#if defined(__SSE2__)
+
+/* reverses the 16 bytes of 'x' */
+static __m128i reverse16 (__m128i x) {
+  x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));  /* bytes */
+  x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));  /* words... */
+  x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));  /* ...and halves */
+}
+
+#endif
+
+/* }====================================================== */
+
+
 static int str_reverse (lua_State *L) {
   size_t l, i;
   luaL_Buffer b;
   const char *s = luaL_checklstring(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
-  for (i = 0; i < l; i++)
+  i = 0;
+#if defined(__SSE2__)
+  for (; l - i >= 16; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(s + l - i - 16));
+    _mm_storeu_si128((__m128i *)(p + i), reverse16(x));
+  }
+#endif
+  for (; i < l; i++)
     p[i] = s[l - i - 1];
   luaL_pushresultsize(&b, l);
   return 1;
@@ -135,12 +248,10 @@ static int str_reverse (lua_State *L) {
 
 static int str_lower (lua_State *L) {
   size_t l;
-  size_t i;
   luaL_Buffer b;
   const char *s = luaL_checklstring(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
-  for (i=0; i<l; i++)
-    p[i] = tolower(uchar(s[i]));
+  convcase(L, p, s, l, tolower, 'A', 'Z', 'a' - 'A');
   luaL_pushresultsize(&b, l);
   return 1;
 }
@@ -152,12 +263,10 @@ static int str_lower (lua_State *L) {
 
 static int str_upper (lua_State *L) {
   size_t l;
-  size_t i;
   luaL_Buffer b;
   const char *s = luaL_checklstring(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
-  for (i=0; i<l; i++)
-    p[i] = toupper(uchar(s[i]));
+  convcase(L, p, s, l, toupper, 'a', 'z', 'A' - 'a');
   luaL_pushresultsize(&b, l);
   return 1;
 }
@@ -178,16 +287,19 @@ static int str_rep (lua_State *L) {
     return luaL_error(L, "resulting string too large");
   else {
     size_t totallen = (size_t)n * l + (size_t)(n - 1) * lsep;
+    size_t done = l;
     luaL_Buffer b;
     char *p = luaL_buffinitsize(L, &b, totallen);
-    while (n-- > 1) {  /* first n-1 copies (followed by separator) */
-      memcpy(p, s, l * sizeof(char)); p += l;
-      if (lsep > 0) {  /* empty 'memcpy' is not that cheap */
-        memcpy(p, sep, lsep * sizeof(char));
-        p += lsep;
-      }
+    memcpy(p, s, l * sizeof(char));  /* first copy */
+    if (n > 1 && lsep > 0) {  /* empty 'memcpy' is not that cheap */
+      memcpy(p + l, sep, lsep * sizeof(char));
+      done += lsep;
+    }
+    while (done < totallen) {  /* double what is done (a prefix of it) */
+      size_t k = (done < totallen - done) ? done : totallen - done;
+      memcpy(p + done, p, k * sizeof(char));
+      done += k;
     }
-    memcpy(p, s, l * sizeof(char));  /* last copy (not followed by separator) */
     luaL_pushresultsize(&b, totallen);
   }
   return 1;
@@ -304,7 +416,6 @@ static int str_dump (lua_State *L) {
 typedef struct MatchState {
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end ('\0') of source string */
-  const char *p_end;  /* end ('\0') of pattern */
   lua_State *L;
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
   unsigned char level;  /* total number of captures (finished or unfinished) */
@@ -318,55 +429,151 @@ typedef struct MatchState {
 /*
   src_init保存目标串的第一个字符
   src_end保存目标串的最后一个字符
-  p_end保存模式串的最后一个字符
   mathchdepth是模式匹配的深度
   level代表捕获的数量
   MatchState用来保存当前匹配的情况
 */
 
-/* recursive function */
-static const char *match (MatchState *ms, const char *s, const char *p);
-
-
 /* maximum recursion depth for 'match' */
 #if !defined(MAXCCALLS)
 #define MAXCCALLS	200
 #endif
 
 
+/*
+** maximum length of the literal prefix kept by a compiled pattern to
+** look for places where it may match
+*/
+#if !defined(LUA_MAXPATPREFIX)
+#define LUA_MAXPATPREFIX	16
+#endif
+
+
 #define L_ESC		'%'
 #define SPECIALS	"^$*+?.([%-"
 
 
-static int check_capture (MatchState *ms, int l) {
-  l -= '1';
-  if (l < 0 || l >= ms->level || ms->capture[l].len == CAP_UNFINISHED)
-    return luaL_error(ms->L, "invalid capture index %%%d", l + 1);
-  return l;
-}
+/*
+** Patterns are compiled into a sequence of items, one for each pattern
+** item, capture delimiter or anchor, ended by a PI_END. Each character
+** class becomes a set of 256 bits, so that 'match' does not need to
+** parse the pattern again at each character. A malformed part of a
+** pattern becomes a PI_ERROR item, so that the error is raised only
+** when the matching reaches it, as before.
+*/
+
+/* kinds of items */
+enum {
+  PI_END,  /* end of pattern */
+  PI_SINGLE,  /* class 'set' with optional suffix 'rep' */
+  PI_OPEN,  /* start of capture */
+  PI_POSITION,  /* position capture */
+  PI_CLOSE,  /* end of capture 'a' */
+  PI_ENDANCHOR,  /* '$' at the end of the pattern */
+  PI_BALANCE,  /* %b with delimiters 'a' and 'b' */
+  PI_FRONTIER,  /* %f with class 'set' */
+  PI_BACKREF,  /* %1-%9 (capture 'a') */
+  PI_ERROR  /* malformed pattern (error 'a', with argument 'b') */
+};
 
+/* maximum number of byte ranges kept for a class (see 'spanset') */
+#define MAXRANGES	3
 
-static int capture_to_close (MatchState *ms) {
-  int level = ms->level;
-  for (level--; level>=0; level--)
-    if (ms->capture[level].len == CAP_UNFINISHED) return level;
-  return luaL_error(ms->L, "invalid pattern capture");
+/* errors for PI_ERROR */
+enum { PE_ENDESC, PE_BRACKET, PE_BALANCE, PE_FRONTIER, PE_INDEX,
+       PE_CAPTURE, PE_TOOMANY };
+
+
+typedef struct PItem {
+  unsigned char op;  /* kind of item */
+  unsigned char rep;  /* suffix of a PI_SINGLE ('?', '*', '+', '-', or 0) */
+  unsigned char must;  /* true if it is a PI_SINGLE matching at least once */
+  unsigned char a, b;  /* arguments */
+  unsigned char set[(UCHAR_MAX + 1) / CHAR_BIT];  /* characters in class */
+  unsigned char nranges;  /* number of ranges in 'set' (0 if too many) */
+  unsigned char range[MAXRANGES][2];  /* its ranges, if few */
+} PItem;
+
+
+typedef struct Pattern {
+  int anchor;  /* true if pattern starts with '^' (not in 'item') */
+  int first;  /* first item that consumes characters, or -1 */
+  size_t lprefix;  /* length of literal prefix of all matches */
+  char prefix[LUA_MAXPATPREFIX];
+  PItem item[1];
+} Pattern;
+
+
+#define inset(it,c)	((it)->set[uchar(c) >> 3] & (1u << (uchar(c) & 7)))
+
+#define singlematch(ms,s,it)	((s) < (ms)->src_end && inset(it, *(s)))
+
+/*
+** true if 'match(ms, s, it)' would fail right away (and so may be
+** skipped; it would raise an error if 'matchdepth' were exhausted)
+*/
+#define failsat(ms,s,it)  \
+	((it)->must && (ms)->matchdepth != 0 && !singlematch(ms, s, it))
+
+
+/*
+** Returns the first position from 's' on (up to 'e') with a byte in
+** the set of 'it', if 'in', or out of it, if not 'in'. With SSE2,
+** sets with few ranges are tested 16 bytes at a time.
+*/
+static const char *scanset (const char *s, const char *e, const PItem *it,
+                            int in) {
+#if defined(__SSE2__)
+  int n = it->nranges;
+  if (n > 0 && e - s >= 16) {
+    __m128i lo[MAXRANGES], hi[MAXRANGES];
+    unsigned int flip = in ? 0 : 0xFFFF;
+    int r;
+    for (r = 0; r < n; r++) {
+      lo[r] = _mm_set1_epi8((char)it->range[r][0]);
+      hi[r] = _mm_set1_epi8((char)it->range[r][1]);
+    }
+    for (; e - s >= 16; s += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)s);
+      __m128i m = _mm_setzero_si128();
+      unsigned int bits;
+      /* lo <= x <= hi  iff  max(x, lo) == min(x, hi) */
+      for (r = 0; r < n; r++)
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(x, lo[r]),
+                                           _mm_min_epu8(x, hi[r])));
+      bits = (unsigned int)_mm_movemask_epi8(m) ^ flip;
+      if (bits != 0)
+        return s + lowbit(bits);
+    }
+  }
+#endif
+  while (s < e && (inset(it, *s) != 0) != in)
+    s++;
+  return s;
 }
 
 
-static const char *classend (MatchState *ms, const char *p) {
+/* recursive function */
+static const char *match (MatchState *ms, const char *s, const PItem *p);
+
+
+/*
+** Returns the end of the class starting at 'p', or NULL if it is
+** malformed.
+*/
+static const char *classend (const char *p, const char *p_end) {
   switch (*p++) {
     case L_ESC: {
-      if (p == ms->p_end)
-        luaL_error(ms->L, "malformed pattern (ends with '%%')");
+      if (p == p_end)
+        return NULL;  /* pattern ends with '%' */
       return p+1;
     }
     case '[': {
       if (*p == '^') p++;
       do {  /* look for a ']' */
-        if (p == ms->p_end)
-          luaL_error(ms->L, "malformed pattern (missing ']')");
-        if (*(p++) == L_ESC && p < ms->p_end)
+        if (p == p_end)
+          return NULL;  /* missing ']' */
+        if (*(p++) == L_ESC && p < p_end)
           p++;  /* skip escapes (e.g. '%]') */
       } while (*p != ']');
       return p+1;
@@ -421,36 +628,249 @@ static int matchbracketclass (int c, const char *p, const char *ec) {
 }
 
 
-static int singlematch (MatchState *ms, const char *s, const char *p,
-                        const char *ep) {
-  if (s >= ms->src_end)
-    return 0;
-  else {
-    int c = uchar(*s);
+static int classmatch (int c, const char *p, const char *ep) {
+  switch (*p) {
+    case '.': return 1;  /* matches any char */
+    case L_ESC: return match_class(c, uchar(*(p+1)));
+    case '[': return matchbracketclass(c, p, ep-1);
+    default:  return (uchar(*p) == c);
+  }
+}
+
+
+/*
+** Fills the set of item 'it' with the characters in the class between
+** 'p' and 'ep', and its ranges, if they are at most MAXRANGES.
+** (Classes are evaluated with the locale current at compilation.)
+*/
+static void buildset (PItem *it, const char *p, const char *ep) {
+  int c;
+  int n = 0;  /* number of ranges */
+  memset(it->set, 0, sizeof(it->set));
+  for (c = 0; c <= UCHAR_MAX; c++) {
+    if (classmatch(c, p, ep)) {
+      it->set[c >> 3] |= uchar(1u << (c & 7));
+      if (c > 0 && inset(it, c - 1)) {  /* continues a range? */
+        if (n <= MAXRANGES)
+          it->range[n - 1][1] = uchar(c);
+      }
+      else if (++n <= MAXRANGES)  /* starts a new one */
+        it->range[n - 1][0] = it->range[n - 1][1] = uchar(c);
+    }
+  }
+  it->nranges = (n <= MAXRANGES) ? uchar(n) : 0;
+}
+
+
+/*
+** Compiles pattern 'p' into 'items', returning the number of items.
+** If 'items' is NULL, only counts them.
+*/
+static int compile (const char *p, const char *p_end, PItem *items) {
+  PItem dummy;
+  int n = 0;
+  int level = 0;  /* total number of captures */
+  char open[LUA_MAXCAPTURES];  /* whether each capture is unfinished */
+  for (;; n++) {
+    PItem *it = (items != NULL) ? &items[n] : &dummy;
+    it->rep = it->must = 0;
+    if (p == p_end) {  /* end of pattern? */
+      it->op = PI_END;
+      return n + 1;
+    }
     switch (*p) {
-      case '.': return 1;  /* matches any char */
-      case L_ESC: return match_class(c, uchar(*(p+1)));
-      case '[': return matchbracketclass(c, p, ep-1);
-      default:  return (uchar(*p) == c);
+      case '(': {  /* start capture */
+        if (level >= LUA_MAXCAPTURES) {
+          it->op = PI_ERROR; it->a = PE_TOOMANY;
+          return n + 1;
+        }
+        if (*(p + 1) == ')') {  /* position capture? */
+          it->op = PI_POSITION; p += 2;
+          open[level++] = 0;
+        }
+        else {
+          it->op = PI_OPEN; p++;
+          open[level++] = 1;
+        }
+        continue;
+      }
+      case ')': {  /* end capture */
+        int l;
+        for (l = level - 1; l >= 0 && !open[l]; l--) ;
+        if (l < 0) {  /* no capture to close? */
+          it->op = PI_ERROR; it->a = PE_CAPTURE;
+          return n + 1;
+        }
+        open[l] = 0;
+        it->op = PI_CLOSE; it->a = uchar(l); p++;
+        continue;
+      }
+      case '$': {
+        if ((p + 1) != p_end)  /* is the '$' the last char in pattern? */
+          goto dflt;  /* no; go to default */
+        it->op = PI_ENDANCHOR; p++;
+        continue;
+      }
+      case L_ESC: {  /* escaped sequences not in the format class[*+?-]? */
+        switch (*(p + 1)) {
+          case 'b': {  /* balanced string? */
+            if (p + 2 >= p_end - 1) {
+              it->op = PI_ERROR; it->a = PE_BALANCE;
+              return n + 1;
+            }
+            it->op = PI_BALANCE;
+            it->a = uchar(*(p + 2)); it->b = uchar(*(p + 3));
+            p += 4;
+            continue;
+          }
+          case 'f': {  /* frontier? */
+            const char *ep;
+            p += 2;
+            if (*p != '[') {
+              it->op = PI_ERROR; it->a = PE_FRONTIER;
+              return n + 1;
+            }
+            if ((ep = classend(p, p_end)) == NULL) {
+              it->op = PI_ERROR; it->a = PE_BRACKET;
+              return n + 1;
+            }
+            it->op = PI_FRONTIER;
+            buildset(it, p, ep);
+            p = ep;
+            continue;
+          }
+          case '0': case '1': case '2': case '3':
+          case '4': case '5': case '6': case '7':
+          case '8': case '9': {  /* capture results (%0-%9)? */
+            int l = uchar(*(p + 1)) - '1';
+            if (l < 0 || l >= level || open[l]) {
+              it->op = PI_ERROR; it->a = PE_INDEX; it->b = uchar(l + 1);
+              return n + 1;
+            }
+            it->op = PI_BACKREF; it->a = uchar(l);
+            p += 2;
+            continue;
+          }
+          default: goto dflt;
+        }
+      }
+      default: dflt: {  /* pattern class plus optional suffix */
+        const char *ep = classend(p, p_end);  /* points to optional suffix */
+        if (ep == NULL) {
+          it->op = PI_ERROR; it->a = (*p == L_ESC) ? PE_ENDESC : PE_BRACKET;
+          return n + 1;
+        }
+        it->op = PI_SINGLE;
+        buildset(it, p, ep);
+        p = ep;
+        if (*p == '?' || *p == '*' || *p == '+' || *p == '-')
+          it->rep = uchar(*p++);
+        it->must = (it->rep == 0 || it->rep == '+');
+        continue;
+      }
     }
   }
 }
 
 
+static int patternerror (MatchState *ms, const PItem *p) {
+  static const char *const msgs[] = {
+    "malformed pattern (ends with '%')",
+    "malformed pattern (missing ']')",
+    "malformed pattern (missing arguments to '%b')",
+    "missing '[' after '%f' in pattern",
+    NULL,  /* PE_INDEX */
+    "invalid pattern capture",
+    "too many captures"
+  };
+  if (p->a == PE_INDEX)
+    return luaL_error(ms->L, "invalid capture index %%%d", p->b);
+  return luaL_error(ms->L, "%s", msgs[p->a]);
+}
+
+
+/*
+** Collects in 'pt' what all matches must start with: the (one-char)
+** class of its first item that consumes characters, if it must match,
+** and the literal characters they must start with.
+*/
+static void findprefix (Pattern *pt) {
+  const PItem *it = pt->item;
+  pt->first = -1;
+  pt->lprefix = 0;
+  while (it->op == PI_OPEN || it->op == PI_POSITION)
+    it++;  /* captures do not consume characters */
+  if (!it->must)
+    return;
+  pt->first = (int)(it - pt->item);
+  for (; it->must && pt->lprefix < LUA_MAXPATPREFIX; it++) {
+    int c, nc = 0;
+    for (c = 0; c <= UCHAR_MAX && nc < 2; c++)
+      if (inset(it, c)) nc++;
+    if (nc != 1)  /* not a single character? */
+      break;
+    for (c = 0; !inset(it, c); c++) ;
+    pt->prefix[pt->lprefix++] = (char)c;
+    if (it->rep == '+')  /* may repeat? */
+      break;  /* what follows it is not fixed */
+  }
+}
+
+
+/*
+** Compiles pattern 'p' into a new full userdata, which is left on the
+** top of the stack. If 'anchor', an initial '^' is an anchor.
+*/
+static Pattern *compilepattern (lua_State *L, const char *p, size_t lp,
+                                int anchor) {
+  Pattern *pt;
+  int n;
+  anchor = anchor && (*p == '^');
+  if (anchor) {
+    p++; lp--;  /* skip anchor character */
+  }
+  n = compile(p, p + lp, NULL);
+  pt = (Pattern *)lua_newuserdata(L,
+                       offsetof(Pattern, item) + n * sizeof(PItem));
+  compile(p, p + lp, pt->item);
+  pt->anchor = anchor;
+  findprefix(pt);
+  return pt;
+}
+
+
+/*
+** Gets the compiled form of pattern 'p' (at index 'arg'), leaving it
+** on the top of the stack. Compiled patterns are kept in a table with weak
+** values (the first upvalue of the library functions, also in the
+** registry so that 'os.setlocale' can clear it).
+*/
+static const Pattern *getpattern (lua_State *L, int arg,
+                                  const char *p, size_t lp) {
+  lua_pushvalue(L, arg);
+  if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TUSERDATA) {  /* new? */
+    lua_pop(L, 1);
+    compilepattern(L, p, lp, 1);
+    lua_pushvalue(L, arg);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, lua_upvalueindex(1));  /* cache[p] = compiled pattern */
+  }
+  return (const Pattern *)lua_touserdata(L, -1);
+}
+
+
 static const char *matchbalance (MatchState *ms, const char *s,
-                                   const char *p) {
-  if (p >= ms->p_end - 1)
-    luaL_error(ms->L, "malformed pattern (missing arguments to '%%b')");
-  if (*s != *p) return NULL;
+                                   const PItem *p) {
+  if (s >= ms->src_end || uchar(*s) != p->a) return NULL;
   else {
-    int b = *p;
-    int e = *(p+1);
+    int b = p->a;
+    int e = p->b;
     int cont = 1;
     while (++s < ms->src_end) {
-      if (*s == e) {
+      if (uchar(*s) == e) {
         if (--cont == 0) return s+1;
       }
-      else if (*s == b) cont++;
+      else if (uchar(*s) == b) cont++;
     }
   }
   return NULL;  /* string ends out of balance */
@@ -458,14 +878,15 @@ static const char *matchbalance (MatchState *ms, const char *s,
 
 
 static const char *max_expand (MatchState *ms, const char *s,
-                                 const char *p, const char *ep) {
-  ptrdiff_t i = 0;  /* counts maximum expand for item */
-  while (singlematch(ms, s + i, p, ep))
-    i++;
+                                 const PItem *p) {
+  /* counts maximum expand for item */
+  ptrdiff_t i = scanset(s, ms->src_end, p, 0) - s;
   /* keeps trying to match with the maximum repetitions */
   while (i>=0) {
-    const char *res = match(ms, (s+i), ep+1);
-    if (res) return res;
+    if (!failsat(ms, s + i, p + 1)) {
+      const char *res = match(ms, (s+i), p + 1);
+      if (res) return res;
+    }
     i--;  /* else didn't match; reduce 1 repetition to try again */
   }
   return NULL;
@@ -473,12 +894,12 @@ static const char *max_expand (MatchState *ms, const char *s,
 
 
 static const char *min_expand (MatchState *ms, const char *s,
-                                 const char *p, const char *ep) {
+                                 const PItem *p) {
   for (;;) {
-    const char *res = match(ms, s, ep+1);
+    const char *res = failsat(ms, s, p + 1) ? NULL : match(ms, s, p + 1);
     if (res != NULL)
       return res;
-    else if (singlematch(ms, s, p, ep))
+    else if (singlematch(ms, s, p))
       s++;  /* try with one more repetition */
     else return NULL;
   }
@@ -486,10 +907,9 @@ static const char *min_expand (MatchState *ms, const char *s,
 
 
 static const char *start_capture (MatchState *ms, const char *s,
-                                    const char *p, int what) {
+                                    const PItem *p, int what) {
   const char *res;
   int level = ms->level;
-  if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
   ms->capture[level].init = s;
   ms->capture[level].len = what;
   ms->level = level+1;
@@ -500,20 +920,18 @@ static const char *start_capture (MatchState *ms, const char *s,
 
 
 static const char *end_capture (MatchState *ms, const char *s,
-                                  const char *p) {
-  int l = capture_to_close(ms);
+                                  const PItem *p) {
+  int l = p->a;
   const char *res;
   ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
-  if ((res = match(ms, s, p)) == NULL)  /* match failed? */
+  if ((res = match(ms, s, p + 1)) == NULL)  /* match failed? */
     ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
   return res;
 }
 
 
 static const char *match_capture (MatchState *ms, const char *s, int l) {
-  size_t len;
-  l = check_capture(ms, l);
-  len = ms->capture[l].len;
+  size_t len = ms->capture[l].len;
   if ((size_t)(ms->src_end-s) >= len &&
       memcmp(ms->capture[l].init, s, len) == 0)
     return s+len;
@@ -521,101 +939,85 @@ static const char *match_capture (MatchState *ms, const char *s, int l) {
 }
 
 
-static const char *match (MatchState *ms, const char *s, const char *p) {
+static const char *match (MatchState *ms, const char *s, const PItem *p) {
   if (ms->matchdepth-- == 0)
     luaL_error(ms->L, "pattern too complex");
   init: /* using goto's to optimize tail recursion */
-  if (p != ms->p_end) {  /* end of pattern? */
-    switch (*p) {
-      case '(': {  /* start capture */
-        if (*(p + 1) == ')')  /* position capture? */
-          s = start_capture(ms, s, p + 2, CAP_POSITION);
-        else
-          s = start_capture(ms, s, p + 1, CAP_UNFINISHED);
-        break;
+  switch (p->op) {
+    case PI_END: break;  /* end of pattern */
+    case PI_OPEN: {  /* start capture */
+      s = start_capture(ms, s, p + 1, CAP_UNFINISHED);
+      break;
+    }
+    case PI_POSITION: {  /* position capture */
+      s = start_capture(ms, s, p + 1, CAP_POSITION);
+      break;
+    }
+    case PI_CLOSE: {  /* end capture */
+      s = end_capture(ms, s, p);
+      break;
+    }
+    case PI_ENDANCHOR: {
+      s = (s == ms->src_end) ? s : NULL;  /* check end of string */
+      break;
+    }
+    case PI_BALANCE: {  /* balanced string? */
+      s = matchbalance(ms, s, p);
+      if (s != NULL) {
+        p++; goto init;  /* return match(ms, s, p + 1); */
+      }  /* else fail (s == NULL) */
+      break;
+    }
+    case PI_FRONTIER: {
+      char previous = (s == ms->src_init) ? '\0' : *(s - 1);
+      if (!inset(p, previous) && inset(p, *s)) {
+        p++; goto init;  /* return match(ms, s, p + 1); */
       }
-      case ')': {  /* end capture */
-        s = end_capture(ms, s, p + 1);
-        break;
+      s = NULL;  /* match failed */
+      break;
+    }
+    case PI_BACKREF: {  /* capture results (%0-%9)? */
+      s = match_capture(ms, s, p->a);
+      if (s != NULL) {
+        p++; goto init;  /* return match(ms, s, p + 1) */
       }
-      case '$': {
-        if ((p + 1) != ms->p_end)  /* is the '$' the last char in pattern? */
-          goto dflt;  /* no; go to default */
-        s = (s == ms->src_end) ? s : NULL;  /* check end of string */
-        break;
+      break;
+    }
+    case PI_ERROR: patternerror(ms, p); break;
+    default: {  /* pattern class plus optional suffix */
+      /* does not match at least once? */
+      if (!singlematch(ms, s, p)) {
+        if (!p->must) {  /* accept empty? */
+          p++; goto init;  /* return match(ms, s, p + 1); */
+        }
+        else  /* '+' or no suffix */
+          s = NULL;  /* fail */
       }
-      case L_ESC: {  /* escaped sequences not in the format class[*+?-]? */
-        switch (*(p + 1)) {
-          case 'b': {  /* balanced string? */
-            s = matchbalance(ms, s, p + 2);
-            if (s != NULL) {
-              p += 4; goto init;  /* return match(ms, s, p + 4); */
-            }  /* else fail (s == NULL) */
-            break;
-          }
-          case 'f': {  /* frontier? */
-            const char *ep; char previous;
-            p += 2;
-            if (*p != '[')
-              luaL_error(ms->L, "missing '[' after '%%f' in pattern");
-            ep = classend(ms, p);  /* points to what is next */
-            previous = (s == ms->src_init) ? '\0' : *(s - 1);
-            if (!matchbracketclass(uchar(previous), p, ep - 1) &&
-               matchbracketclass(uchar(*s), p, ep - 1)) {
-              p = ep; goto init;  /* return match(ms, s, ep); */
+      else {  /* matched once */
+        switch (p->rep) {  /* handle optional suffix */
+          case '?': {  /* optional */
+            const char *res;
+            if ((res = match(ms, s + 1, p + 1)) != NULL)
+              s = res;
+            else {
+              p++; goto init;  /* else return match(ms, s, p + 1); */
             }
-            s = NULL;  /* match failed */
             break;
           }
-          case '0': case '1': case '2': case '3':
-          case '4': case '5': case '6': case '7':
-          case '8': case '9': {  /* capture results (%0-%9)? */
-            s = match_capture(ms, s, uchar(*(p + 1)));
-            if (s != NULL) {
-              p += 2; goto init;  /* return match(ms, s, p + 2) */
-            }
+          case '+':  /* 1 or more repetitions */
+            s++;  /* 1 match already done */
+            /* FALLTHROUGH */
+          case '*':  /* 0 or more repetitions */
+            s = max_expand(ms, s, p);
             break;
-          }
-          default: goto dflt;
-        }
-        break;
-      }
-      default: dflt: {  /* pattern class plus optional suffix */
-        const char *ep = classend(ms, p);  /* points to optional suffix */
-        /* does not match at least once? */
-        if (!singlematch(ms, s, p, ep)) {
-          if (*ep == '*' || *ep == '?' || *ep == '-') {  /* accept empty? */
-            p = ep + 1; goto init;  /* return match(ms, s, ep + 1); */
-          }
-          else  /* '+' or no suffix */
-            s = NULL;  /* fail */
-        }
-        else {  /* matched once */
-          switch (*ep) {  /* handle optional suffix */
-            case '?': {  /* optional */
-              const char *res;
-              if ((res = match(ms, s + 1, ep + 1)) != NULL)
-                s = res;
-              else {
-                p = ep + 1; goto init;  /* else return match(ms, s, ep + 1); */
-              }
-              break;
-            }
-            case '+':  /* 1 or more repetitions */
-              s++;  /* 1 match already done */
-              /* FALLTHROUGH */
-            case '*':  /* 0 or more repetitions */
-              s = max_expand(ms, s, p, ep);
-              break;
-            case '-':  /* 0 or more repetitions (minimum) */
-              s = min_expand(ms, s, p, ep);
-              break;
-            default:  /* no suffix */
-              s++; p = ep; goto init;  /* return match(ms, s + 1, ep); */
-          }
+          case '-':  /* 0 or more repetitions (minimum) */
+            s = min_expand(ms, s, p);
+            break;
+          default:  /* no suffix */
+            s++; p++; goto init;  /* return match(ms, s + 1, p + 1); */
         }
-        break;
       }
+      break;
     }
   }
   ms->matchdepth++;
@@ -624,27 +1026,141 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
 
 
 
+/*
+** {======================================================
+** PLAIN SEARCH
+** =======================================================
+*/
+
+/*
+** 'lmemfind' only compares the places where both the first and the
+** last bytes of the searched string match (testing 16 places at a time
+** when SSE2 is available). That may take quadratic time in bad cases
+** (e.g., "aa...ab" in "aa...a"), so a search that has compared too
+** many bytes for what it has advanced goes on with the Two-Way
+** algorithm, which takes linear time.
+*/
+
+/* bytes compared per byte advanced before switching to Two-Way */
+#if !defined(LUAI_FINDWORK)
+#define LUAI_FINDWORK		8
+#endif
+
+
+/*
+** Computes the maximal suffix of 'n' (with 'm' bytes) for the byte
+** order (reversed if 'rev'), returning its start minus one and its
+** period in '*period'.
+*/
+static size_t maxsuffix (const unsigned char *n, size_t m, size_t *period,
+                         int rev) {
+  size_t ip = (size_t)-1;  /* (start of suffix) - 1 */
+  size_t jp = 0, k = 1, p = 1;
+  while (jp + k < m) {
+    int a = n[ip + k];
+    int b = n[jp + k];
+    if (a == b) {
+      if (k == p) { jp += p; k = 1; }
+      else k++;
+    }
+    else if ((a > b) != rev) {
+      jp += k; k = 1;
+      p = jp - ip;
+    }
+    else {
+      ip = jp++;
+      k = p = 1;
+    }
+  }
+  *period = p;
+  return ip;
+}
+
+
+/*
+** Two-Way search (Crochemore and Perrin) for 'ns' (with 'm' > 0 bytes)
+** in 'hs' (with 'l' bytes), in time linear on 'l + m' and constant
+** space.
+*/
+static const char *twoway (const char *hs, size_t l, const char *ns,
+                           size_t m) {
+  const unsigned char *h = (const unsigned char *)hs;
+  const unsigned char *n = (const unsigned char *)ns;
+  const unsigned char *end = h + l;
+  size_t p, p1, mem0, k;
+  size_t mem = 0;  /* bytes of the periodic part known to match */
+  size_t ms = maxsuffix(n, m, &p, 0);
+  size_t ms1 = maxsuffix(n, m, &p1, 1);
+  if (ms1 + 1 > ms + 1) {  /* critical factorization from the other one? */
+    ms = ms1; p = p1;
+  }
+  if (memcmp(n, n + p, ms + 1) != 0) {  /* not periodic? */
+    mem0 = 0;
+    p = ((ms > m - ms - 1) ? ms : m - ms - 1) + 1;
+  }
+  else mem0 = m - p;
+  while ((size_t)(end - h) >= m) {
+    /* compare right part */
+    for (k = (ms + 1 > mem) ? ms + 1 : mem; k < m && n[k] == h[k]; k++) ;
+    if (k < m) {
+      h += k - ms; mem = 0;
+      continue;
+    }
+    /* compare left part */
+    for (k = ms + 1; k > mem && n[k - 1] == h[k - 1]; k--) ;
+    if (k <= mem)
+      return (const char *)h;
+    h += p; mem = mem0;
+  }
+  return NULL;
+}
+
+
 static const char *lmemfind (const char *s1, size_t l1,
                                const char *s2, size_t l2) {
   if (l2 == 0) return s1;  /* empty strings are everywhere */
   else if (l2 > l1) return NULL;  /* avoids a negative 'l1' */
+  else if (l2 == 1) return (const char *)memchr(s1, *s2, l1);
   else {
-    const char *init;  /* to search for a '*s2' inside 's1' */
-    l2--;  /* 1st char will be checked by 'memchr' */
-    l1 = l1-l2;  /* 's2' cannot be found after that */
-    while (l1 > 0 && (init = (const char *)memchr(s1, *s2, l1)) != NULL) {
-      init++;   /* 1st char is already checked */
-      if (memcmp(init, s2+1, l2) == 0)
-        return init-1;
-      else {  /* correct 'l1' and 's1' to try again */
-        l1 -= init-s1;
-        s1 = init;
+    const char *s = s1;
+    const char *last = s1 + (l1 - l2);  /* last place where it may be */
+    size_t work = 0;  /* bytes compared so far (at most) */
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(s2[0]);
+    const __m128i lastc = _mm_set1_epi8(s2[l2 - 1]);
+    while (last - s >= 16) {  /* 16 more places? */
+      __m128i f = _mm_cmpeq_epi8(first,
+                    _mm_loadu_si128((const __m128i *)s));
+      __m128i e = _mm_cmpeq_epi8(lastc,
+                    _mm_loadu_si128((const __m128i *)(s + l2 - 1)));
+      unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_and_si128(f, e));
+      while (m != 0) {  /* check each candidate */
+        const char *c = s + lowbit(m);
+        if (memcmp(c + 1, s2 + 1, l2 - 2) == 0)
+          return c;
+        work += l2;
+        if (work > LUAI_FINDWORK * ((size_t)(s - s1) + l2))
+          return twoway(s, l1 - (s - s1), s2, l2);
+        m &= m - 1;
       }
+      s += 16;
+    }
+#endif
+    while (s <= last &&
+           (s = (const char *)memchr(s, *s2, last - s + 1)) != NULL) {
+      if (s[l2 - 1] == s2[l2 - 1] && memcmp(s + 1, s2 + 1, l2 - 2) == 0)
+        return s;
+      work += l2;
+      if (work > LUAI_FINDWORK * ((size_t)(s - s1) + l2))
+        return twoway(s, l1 - (s - s1), s2, l2);
+      s++;
     }
     return NULL;  /* not found */
   }
 }
 
+/* }====================================================== */
+
 /*
   extern void *memchr(const void *buf, int ch, size_t count)，功能：从buf所指内存区域的前count个字节查找字符ch。
   当第一次遇到字符ch时停止查找。如果成功，返回指向字符ch的指针；否则返回NULL。
@@ -705,13 +1221,29 @@ static int nospecials (const char *p, size_t l) {
 */
 
 
+/*
+** Returns the first position from 's' on where a match of 'pt' may
+** start, or NULL if there is none.
+*/
+static const char *nextstart (MatchState *ms, const Pattern *pt,
+                              const char *s) {
+  if (pt->lprefix > 0)
+    return lmemfind(s, ms->src_end - s, pt->prefix, pt->lprefix);
+  else if (pt->first >= 0) {
+    s = scanset(s, ms->src_end, &pt->item[pt->first], 1);
+    return (s < ms->src_end) ? s : NULL;
+  }
+  else
+    return s;
+}
+
+
 static void prepstate (MatchState *ms, lua_State *L,
-                       const char *s, size_t ls, const char *p, size_t lp) {
+                       const char *s, size_t ls) {
   ms->L = L;
   ms->matchdepth = MAXCCALLS;
   ms->src_init = s;
   ms->src_end = s + ls;
-  ms->p_end = p + lp;
 }
 
 /*
@@ -749,15 +1281,15 @@ static int str_find_aux (lua_State *L, int find) {
   else {
     MatchState ms;
     const char *s1 = s + init - 1;
-    int anchor = (*p == '^');
-    if (anchor) {
-      p++; lp--;  /* skip anchor character */
-    }
-    prepstate(&ms, L, s, ls, p, lp);
+    const Pattern *pt = getpattern(L, 2, p, lp);
+    int anchor = pt->anchor;
+    prepstate(&ms, L, s, ls);
     do {
       const char *res;
+      if (!anchor && (s1 = nextstart(&ms, pt, s1)) == NULL)
+        break;  /* no more places where it can match */
       reprepstate(&ms);
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if ((res=match(&ms, s1, pt->item)) != NULL) {
         if (find) {
           lua_pushinteger(L, (s1 - s) + 1);  /* start */
           lua_pushinteger(L, res - s);   /* end */
@@ -802,20 +1334,23 @@ static int str_match (lua_State *L) {
 /* state for 'gmatch' */
 typedef struct GMatchState {
   const char *src;  /* current position */
-  const char *p;  /* pattern */
+  const Pattern *pt;  /* pattern */
   const char *lastmatch;  /* end of last match */
   MatchState ms;  /* match state */
 } GMatchState;
 
 
 static int gmatch_aux (lua_State *L) {
-  GMatchState *gm = (GMatchState *)lua_touserdata(L, lua_upvalueindex(3));
+  GMatchState *gm = (GMatchState *)lua_touserdata(L, lua_upvalueindex(4));
   const char *src;
   gm->ms.L = L;
   for (src = gm->src; src <= gm->ms.src_end; src++) {
     const char *e;
+    if ((src = nextstart(&gm->ms, gm->pt, src)) == NULL)
+      break;  /* no more places where it can match */
     reprepstate(&gm->ms);
-    if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
+    if ((e = match(&gm->ms, src, gm->pt->item)) != NULL &&
+        e != gm->lastmatch) {
       gm->src = gm->lastmatch = e;
       return push_captures(&gm->ms, src, e);
     }
@@ -828,12 +1363,17 @@ static int gmatch (lua_State *L) {
   size_t ls, lp;
   const char *s = luaL_checklstring(L, 1, &ls);
   const char *p = luaL_checklstring(L, 2, &lp);
+  const Pattern *pt;
   GMatchState *gm;
   lua_settop(L, 2);  /* keep them on closure to avoid being collected */
+  if (*p == '^')  /* not an anchor here? */
+    pt = compilepattern(L, p, lp, 0);  /* (not cached) */
+  else
+    pt = getpattern(L, 2, p, lp);
   gm = (GMatchState *)lua_newuserdata(L, sizeof(GMatchState));
-  prepstate(&gm->ms, L, s, ls, p, lp);
-  gm->src = s; gm->p = p; gm->lastmatch = NULL;
-  lua_pushcclosure(L, gmatch_aux, 3);
+  prepstate(&gm->ms, L, s, ls);
+  gm->src = s; gm->pt = pt; gm->lastmatch = NULL;
+  lua_pushcclosure(L, gmatch_aux, 4);
   return 1;
 }
 
@@ -904,22 +1444,29 @@ static int str_gsub (lua_State *L) {
   const char *lastmatch = NULL;  /* end of last match */
   int tr = lua_type(L, 3);  /* replacement type */
   lua_Integer max_s = luaL_optinteger(L, 4, srcl + 1);  /* max replacements */
-  int anchor = (*p == '^');
+  const Pattern *pt;
+  int anchor;
   lua_Integer n = 0;  /* replacement count */
   MatchState ms;
   luaL_Buffer b;
   luaL_argcheck(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
                       "string/function/table expected");
+  pt = getpattern(L, 2, p, lp);
+  anchor = pt->anchor;
   luaL_buffinit(L, &b);
-  if (anchor) {
-    p++; lp--;  /* skip anchor character */
-  }
-  prepstate(&ms, L, src, srcl, p, lp);
+  prepstate(&ms, L, src, srcl);
   while (n < max_s) {
     const char *e;
+    if (!anchor) {  /* skip places where it cannot match */
+      const char *ns = nextstart(&ms, pt, src);
+      if (ns == NULL) break;  /* (rest of subject is added below) */
+      luaL_addlstring(&b, src, ns - src);
+      src = ns;
+    }
     reprepstate(&ms);  /* (re)prepare state for new match */
-    if ((e = match(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
+    e = match(&ms, src, pt->item);
+    if (e != NULL && e != lastmatch) {  /* match? */
       n++;
       add_value(&ms, &b, src, e, tr);  /* add replacement to buffer */
       src = lastmatch = e;
@@ -938,6 +1485,99 @@ static int str_gsub (lua_State *L) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** SPLIT
+** =======================================================
+*/
+
+/*
+** string.split(s, sep [, max [, t]]) stores in t[1..n] the fields of
+** 's' separated by the plain string 'sep' and returns 't' and 'n'. At
+** most 'max' fields are made; the last one keeps the rest of 's'. 't'
+** defaults to a new table; a given table is cleared after 'n', so the
+** same one can be reused for every line. Each field goes straight to
+** 'lua_pushlstring' (short ones are just interned).
+*/
+static int str_split (lua_State *L) {
+  size_t ls, lsep;
+  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *sep = luaL_checklstring(L, 2, &lsep);
+  lua_Integer max = luaL_optinteger(L, 3, LUA_MAXINTEGER);
+  const char *e = s + ls;
+  lua_Integer n = 0;  /* number of fields */
+  lua_Integer k;
+  luaL_argcheck(L, lsep > 0, 2, "empty separator");
+  luaL_argcheck(L, max > 0, 3, "out of range");
+  if (lua_isnoneornil(L, 4)) {
+    lua_settop(L, 3);
+    lua_newtable(L);
+  }
+  else {
+    luaL_checktype(L, 4, LUA_TTABLE);
+    lua_settop(L, 4);
+  }
+  for (;;) {
+    const char *f = (n < max - 1) ? lmemfind(s, e - s, sep, lsep) : NULL;
+    lua_pushlstring(L, s, ((f != NULL) ? f : e) - s);
+    lua_rawseti(L, 4, ++n);
+    if (f == NULL) break;  /* that was the last field */
+    s = f + lsep;
+  }
+  for (k = n + 1; lua_rawgeti(L, 4, k) != LUA_TNIL; k++) {
+    lua_pushnil(L);  /* clear entry left from a previous use */
+    lua_rawseti(L, 4, k);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  lua_pushinteger(L, n);
+  return 2;
+}
+
+
+/*
+** Upvalues: subject, separator, and the position where the next field
+** starts (beyond the end of the subject after the last field).
+*/
+static int fields_aux (lua_State *L) {
+  size_t ls, lsep;
+  const char *s = lua_tolstring(L, lua_upvalueindex(1), &ls);
+  const char *sep = lua_tolstring(L, lua_upvalueindex(2), &lsep);
+  size_t init = (size_t)lua_tointeger(L, lua_upvalueindex(3));
+  const char *f;
+  size_t j;
+  if (init > ls)
+    return 0;  /* no more fields */
+  f = lmemfind(s + init, ls - init, sep, lsep);
+  j = (f != NULL) ? (size_t)(f - s) : ls;  /* end of field */
+  lua_pushinteger(L, (f != NULL) ? (lua_Integer)(j + lsep)
+                                 : (lua_Integer)ls + 1);
+  lua_replace(L, lua_upvalueindex(3));
+  lua_pushinteger(L, (lua_Integer)init + 1);
+  lua_pushinteger(L, (lua_Integer)j);
+  return 2;
+}
+
+
+/*
+** string.fields(s, sep) iterates over the same fields as 'split', but
+** gives their start and end positions instead of creating strings, as
+** 'string.find' would (an empty field has 'j == i - 1').
+*/
+static int str_fields (lua_State *L) {
+  size_t lsep;
+  luaL_checkstring(L, 1);
+  luaL_checklstring(L, 2, &lsep);
+  luaL_argcheck(L, lsep > 0, 2, "empty separator");
+  lua_settop(L, 2);
+  lua_pushinteger(L, 0);
+  lua_pushcclosure(L, fields_aux, 3);
+  return 1;
+}
+
+/* }====================================================== */
+
+
 
 /*
 ** {======================================================
@@ -1043,6 +1683,47 @@ static int lua_number2strx (lua_State *L, char *buff, int sz,
 #define MAX_FORMAT	32
 
 
+/*
+** Format strings are compiled into a sequence of items: plain text
+** (kept as a position in the format string itself) and conversions,
+** each with its specification for 'l_sprintf', length modifier
+** included. Conversions without modifiers for the most common options
+** have their own writers, which do not need 'l_sprintf'. As with
+** patterns, a malformed specification becomes a FI_ERROR item, raised
+** only when the formatting reaches it.
+*/
+
+/* kinds of items */
+enum {
+  FI_END,  /* end of format */
+  FI_TEXT,  /* plain text */
+  FI_INT,  /* '%d' or '%i' */
+  FI_HEX,  /* '%x' or '%X' */
+  FI_FIXED,  /* '%f' or '%.<prec>f' */
+  FI_STRING,  /* '%s' */
+  FI_SPEC,  /* other conversions (option 'conv'), done by 'l_sprintf' */
+  FI_ERROR  /* malformed specification (error 'prec') */
+};
+
+/* errors for FI_ERROR */
+enum { FE_FLAGS, FE_LONG, FE_OPTION };
+
+/* maximum precision handled by FI_FIXED */
+#define MAXFIXEDPREC	15
+
+/* maximum number of digits (and sign) of an integer in base 10 or 16 */
+#define MAXINTDIGITS	((int)sizeof(lua_Integer) * CHAR_BIT / 3 + 2)
+
+
+typedef struct FItem {
+  unsigned char kind;  /* kind of item */
+  char conv;  /* conversion character */
+  unsigned char prec;  /* precision of a FI_FIXED, error of a FI_ERROR */
+  size_t init, len;  /* position and length of a FI_TEXT */
+  char form[MAX_FORMAT];  /* specification of a FI_SPEC */
+} FItem;
+
+
 static void addquoted (luaL_Buffer *b, const char *s, size_t len) {
   luaL_addchar(b, '"');
   while (len--) {
@@ -1116,11 +1797,18 @@ static void addliteral (lua_State *L, luaL_Buffer *b, int arg) {
 }
 
 
-static const char *scanformat (lua_State *L, const char *strfrmt, char *form) {
+/*
+** Scans a conversion specification (after its '%'), copying it into
+** 'form'. Returns the position of its conversion character, or NULL
+** (with an FE_* code in '*err') if the specification is malformed.
+*/
+static const char *scanformat (const char *strfrmt, char *form, int *err) {
   const char *p = strfrmt;
   while (*p != '\0' && strchr(FLAGS, *p) != NULL) p++;  /* skip flags */
-  if ((size_t)(p - strfrmt) >= sizeof(FLAGS)/sizeof(char))
-    luaL_error(L, "invalid format (repeated flags)");
+  if ((size_t)(p - strfrmt) >= sizeof(FLAGS)/sizeof(char)) {
+    *err = FE_FLAGS;
+    return NULL;
+  }
   if (isdigit(uchar(*p))) p++;  /* skip width */
   if (isdigit(uchar(*p))) p++;  /* (2 digits at most) */
   if (*p == '.') {
@@ -1128,8 +1816,10 @@ static const char *scanformat (lua_State *L, const char *strfrmt, char *form) {
     if (isdigit(uchar(*p))) p++;  /* skip precision */
     if (isdigit(uchar(*p))) p++;  /* (2 digits at most) */
   }
-  if (isdigit(uchar(*p)))
-    luaL_error(L, "invalid format (width or precision too long)");
+  if (isdigit(uchar(*p))) {
+    *err = FE_LONG;
+    return NULL;
+  }
   *(form++) = '%';
   memcpy(form, strfrmt, ((p - strfrmt) + 1) * sizeof(char));
   form += (p - strfrmt) + 1;
@@ -1151,80 +1841,294 @@ static void addlenmod (char *form, const char *lenmod) {
 }
 
 
+/*
+** Compiles the conversion specification at 'strfrmt' (after its '%')
+** into 'it'. Returns the position after it, or NULL if it is malformed
+** (and then 'it' is a FI_ERROR).
+*/
+static const char *compilespec (const char *strfrmt, FItem *it) {
+  const char *p;
+  int err = FE_OPTION;
+  it->prec = 0;
+  if ((p = scanformat(strfrmt, it->form, &err)) == NULL) {
+    it->kind = FI_ERROR;
+    it->prec = (unsigned char)err;
+    return NULL;
+  }
+  it->conv = *p;
+  it->kind = FI_SPEC;
+  switch (*p) {
+    case 'd': case 'i':
+      if (p == strfrmt) it->kind = FI_INT;  /* no modifiers? */
+      addlenmod(it->form, LUA_INTEGER_FRMLEN);
+      break;
+    case 'x': case 'X':
+      if (p == strfrmt) it->kind = FI_HEX;
+      addlenmod(it->form, LUA_INTEGER_FRMLEN);
+      break;
+    case 'o': case 'u':
+      addlenmod(it->form, LUA_INTEGER_FRMLEN);
+      break;
+    case 'f':
+      if (p == strfrmt) {  /* '%f'? */
+        it->kind = FI_FIXED;
+        it->prec = 6;
+      }
+      else if (*strfrmt == '.') {  /* only a precision? */
+        int prec = 0;
+        const char *d;
+        for (d = strfrmt + 1; d < p; d++)
+          prec = prec * 10 + (*d - '0');
+        if (prec <= MAXFIXEDPREC) {
+          it->kind = FI_FIXED;
+          it->prec = (unsigned char)prec;
+        }
+      }
+      addlenmod(it->form, LUA_NUMBER_FRMLEN);
+      break;
+    case 'a': case 'A': case 'e': case 'E': case 'g': case 'G':
+      addlenmod(it->form, LUA_NUMBER_FRMLEN);
+      break;
+    case 's':
+      if (p == strfrmt) it->kind = FI_STRING;
+      break;
+    case 'c': case 'q':
+      break;
+    default:  /* also treat cases 'pnLlh' */
+      it->kind = FI_ERROR;
+      it->prec = FE_OPTION;
+      return NULL;
+  }
+  return p + 1;
+}
+
+
+/*
+** Compiles format 'strfrmt' into 'items' (if not NULL). Returns the
+** number of items, including the final FI_END.
+*/
+static int compileformat (const char *strfrmt, const char *strfrmt_end,
+                          FItem *items) {
+  FItem dummy;
+  const char *fmt = strfrmt;
+  int n = 0;
+  while (fmt < strfrmt_end) {
+    const char *t = fmt;  /* start of text */
+    int esc;
+    while (fmt < strfrmt_end && *fmt != L_ESC) fmt++;
+    esc = (fmt < strfrmt_end && *(fmt + 1) == L_ESC);  /* '%%'? */
+    if (fmt + esc > t) {  /* some text (with one '%' if 'esc')? */
+      if (items) {
+        items[n].kind = FI_TEXT;
+        items[n].init = t - strfrmt;
+        items[n].len = (fmt + esc) - t;
+      }
+      n++;
+    }
+    if (esc)
+      fmt += 2;
+    else if (fmt < strfrmt_end) {  /* format item */
+      fmt = compilespec(fmt + 1, items ? &items[n] : &dummy);
+      n++;
+      if (fmt == NULL)  /* malformed specification? */
+        break;  /* formatting cannot go past it */
+    }
+  }
+  if (items) items[n].kind = FI_END;
+  return n + 1;
+}
+
+
+/*
+** Gets the compiled form of the format at index 1, leaving it on the
+** top of the stack. Compiled formats are kept in a table with weak
+** values (the second upvalue of the library functions).
+*/
+static const FItem *getformat (lua_State *L, const char *strfrmt,
+                               size_t sfl) {
+  lua_pushvalue(L, 1);
+  if (lua_rawget(L, lua_upvalueindex(2)) != LUA_TUSERDATA) {  /* new? */
+    int n = compileformat(strfrmt, strfrmt + sfl, NULL);
+    FItem *items;
+    lua_pop(L, 1);
+    items = (FItem *)lua_newuserdata(L, n * sizeof(FItem));
+    compileformat(strfrmt, strfrmt + sfl, items);
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, lua_upvalueindex(2));  /* cache[fmt] = compiled format */
+  }
+  return (const FItem *)lua_touserdata(L, -1);
+}
+
+
+static int formaterror (lua_State *L, const FItem *it) {
+  if (it->prec == FE_FLAGS)
+    return luaL_error(L, "invalid format (repeated flags)");
+  else if (it->prec == FE_LONG)
+    return luaL_error(L, "invalid format (width or precision too long)");
+  else
+    return luaL_error(L, "invalid option '%%%c' to 'format'", it->conv);
+}
+
+
+/*
+** Writes the digits of 'u' in base 'base' (with at least 'min' digits)
+** backwards, ending at 'e'. Returns where they start.
+*/
+static char *todigits (char *e, lua_Unsigned u, unsigned int base,
+                       const char *digits, int min) {
+  do {
+    *--e = digits[u % base];
+    u /= base;
+    min--;
+  } while (u != 0 || min > 0);
+  return e;
+}
+
+
+/*
+** Writes 'n' as '%.<prec>f' would, when that result can be known from
+** 'n * 10^prec' computed in floating point: its rounding to an integer
+** must not depend on the error of the multiplication, that is, its
+** fractional part must not be too near one half. Returns the number of
+** characters written at the end of the 'MAX_ITEM' bytes of 'buff', or
+** 0 if the number must go through 'l_sprintf'.
+*/
+static int addfixed (char *buff, lua_Number n, int prec) {
+#if LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE
+  static const lua_Number pow10[MAXFIXEDPREC + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15
+  };
+  lua_Number a = l_mathop(fabs)(n) * pow10[prec];
+  lua_Number f, d;
+  char *e = buff + MAX_ITEM;
+  char *s;
+  lua_Unsigned u;
+  if (!(a < 1e15 && a < (lua_Number)LUA_MAXINTEGER))
+    return 0;  /* too large (or not a number) */
+  f = l_mathop(floor)(a);
+  d = a - f - 0.5;
+  if (l_mathop(fabs)(d) <= a * l_mathlim(EPSILON))
+    return 0;  /* too close to a tie */
+  u = (lua_Unsigned)f + (d > 0);  /* rounded value */
+  s = e;
+  if (prec > 0) {  /* write fraction */
+    s = todigits(s, u % (lua_Unsigned)pow10[prec], 10, "0123456789", prec);
+    *--s = lua_getlocaledecpoint();
+  }
+  s = todigits(s, u / (lua_Unsigned)pow10[prec], 10, "0123456789", 1);
+  if (n < 0 || (n == 0 && 1 / n < 0))  /* negative (or -0.0)? */
+    *--s = '-';
+  return (int)(e - s);
+#else
+  (void)buff; (void)n; (void)prec;
+  return 0;
+#endif
+}
+
+
 static int str_format (lua_State *L) {
   int top = lua_gettop(L);
   int arg = 1;
   size_t sfl;
   const char *strfrmt = luaL_checklstring(L, arg, &sfl);
-  const char *strfrmt_end = strfrmt+sfl;
+  const FItem *it = getformat(L, strfrmt, sfl);
   luaL_Buffer b;
   luaL_buffinit(L, &b);
-  while (strfrmt < strfrmt_end) {
-    if (*strfrmt != L_ESC)
-      luaL_addchar(&b, *strfrmt++);
-    else if (*++strfrmt == L_ESC)
-      luaL_addchar(&b, *strfrmt++);  /* %% */
-    else { /* format item */
-      char form[MAX_FORMAT];  /* to store the format ('%...') */
-      char *buff = luaL_prepbuffsize(&b, MAX_ITEM);  /* to put formatted item */
-      int nb = 0;  /* number of bytes in added item */
-      if (++arg > top)
-        luaL_argerror(L, arg, "no value");
-      strfrmt = scanformat(L, strfrmt, form);
-      switch (*strfrmt++) {
-        case 'c': {
-          nb = l_sprintf(buff, MAX_ITEM, form, (int)luaL_checkinteger(L, arg));
-          break;
-        }
-        case 'd': case 'i':
-        case 'o': case 'u': case 'x': case 'X': {
-          lua_Integer n = luaL_checkinteger(L, arg);
-          addlenmod(form, LUA_INTEGER_FRMLEN);
-          nb = l_sprintf(buff, MAX_ITEM, form, (LUAI_UACINT)n);
-          break;
-        }
-        case 'a': case 'A':
-          addlenmod(form, LUA_NUMBER_FRMLEN);
-          nb = lua_number2strx(L, buff, MAX_ITEM, form,
-                                  luaL_checknumber(L, arg));
-          break;
-        case 'e': case 'E': case 'f':
-        case 'g': case 'G': {
-          lua_Number n = luaL_checknumber(L, arg);
-          addlenmod(form, LUA_NUMBER_FRMLEN);
-          nb = l_sprintf(buff, MAX_ITEM, form, (LUAI_UACNUMBER)n);
-          break;
-        }
-        case 'q': {
-          addliteral(L, &b, arg);
-          break;
+  for (; it->kind != FI_END; it++) {
+    char *buff;  /* to put formatted item */
+    int nb = 0;  /* number of bytes in added item */
+    if (it->kind == FI_TEXT) {
+      luaL_addlstring(&b, strfrmt + it->init, it->len);
+      continue;
+    }
+    if (++arg > top)
+      luaL_argerror(L, arg, "no value");
+    switch (it->kind) {
+      case FI_INT: case FI_HEX: {
+        char digits[MAXINTDIGITS];
+        lua_Integer n = luaL_checkinteger(L, arg);
+        char *s;
+        if (it->kind == FI_HEX)
+          s = todigits(digits + MAXINTDIGITS, (lua_Unsigned)n, 16,
+                (it->conv == 'x') ? "0123456789abcdef" : "0123456789ABCDEF",
+                1);
+        else if (n < 0) {
+          s = todigits(digits + MAXINTDIGITS, 0u - (lua_Unsigned)n, 10,
+                       "0123456789", 1);
+          *--s = '-';
         }
-        case 's': {
-          size_t l;
-          const char *s = luaL_tolstring(L, arg, &l);
-          if (form[2] == '\0')  /* no modifiers? */
-            luaL_addvalue(&b);  /* keep entire string */
-          else {
+        else
+          s = todigits(digits + MAXINTDIGITS, (lua_Unsigned)n, 10,
+                       "0123456789", 1);
+        luaL_addlstring(&b, s, (digits + MAXINTDIGITS) - s);
+        continue;
+      }
+      case FI_FIXED: {
+        lua_Number n = luaL_checknumber(L, arg);
+        buff = luaL_prepbuffsize(&b, MAX_ITEM);
+        if ((nb = addfixed(buff, n, it->prec)) > 0)
+          memmove(buff, buff + MAX_ITEM - nb, nb);
+        else
+          nb = l_sprintf(buff, MAX_ITEM, it->form, (LUAI_UACNUMBER)n);
+        break;
+      }
+      case FI_STRING: {
+        luaL_tolstring(L, arg, NULL);
+        luaL_addvalue(&b);  /* keep entire string */
+        continue;
+      }
+      case FI_ERROR:
+        return formaterror(L, it);
+      default: {  /* FI_SPEC */
+        buff = luaL_prepbuffsize(&b, MAX_ITEM);
+        switch (it->conv) {
+          case 'c': {
+            nb = l_sprintf(buff, MAX_ITEM, it->form,
+                              (int)luaL_checkinteger(L, arg));
+            break;
+          }
+          case 'd': case 'i':
+          case 'o': case 'u': case 'x': case 'X': {
+            lua_Integer n = luaL_checkinteger(L, arg);
+            nb = l_sprintf(buff, MAX_ITEM, it->form, (LUAI_UACINT)n);
+            break;
+          }
+          case 'a': case 'A':
+            nb = lua_number2strx(L, buff, MAX_ITEM, it->form,
+                                    luaL_checknumber(L, arg));
+            break;
+          case 'e': case 'E': case 'f':
+          case 'g': case 'G': {
+            lua_Number n = luaL_checknumber(L, arg);
+            nb = l_sprintf(buff, MAX_ITEM, it->form, (LUAI_UACNUMBER)n);
+            break;
+          }
+          case 'q': {
+            addliteral(L, &b, arg);
+            break;
+          }
+          case 's': {  /* (with modifiers) */
+            size_t l;
+            const char *s = luaL_tolstring(L, arg, &l);
             luaL_argcheck(L, l == strlen(s), arg, "string contains zeros");
-            if (!strchr(form, '.') && l >= 100) {
+            if (!strchr(it->form, '.') && l >= 100) {
               /* no precision and string is too long to be formatted */
               luaL_addvalue(&b);  /* keep entire string */
             }
             else {  /* format the string into 'buff' */
-              nb = l_sprintf(buff, MAX_ITEM, form, s);
+              nb = l_sprintf(buff, MAX_ITEM, it->form, s);
               lua_pop(L, 1);  /* remove result from 'luaL_tolstring' */
             }
+            break;
           }
-          break;
-        }
-        default: {  /* also treat cases 'pnLlh' */
-          return luaL_error(L, "invalid option '%%%c' to 'format'",
-                               *(strfrmt - 1));
         }
+        break;
       }
-      lua_assert(nb < MAX_ITEM);
-      luaL_addsize(&b, nb);
     }
+    lua_assert(nb < MAX_ITEM);
+    luaL_addsize(&b, nb);
   }
   luaL_pushresult(&b);
   return 1;
@@ -1682,6 +2586,7 @@ static const luaL_Reg strlib[] = {
   {"char", str_char},
   {"dump", str_dump},
   {"find", str_find},
+  {"fields", str_fields},
   {"format", str_format},
   {"gmatch", gmatch},
   {"gsub", str_gsub},
@@ -1690,6 +2595,7 @@ static const luaL_Reg strlib[] = {
   {"match", str_match},
   {"rep", str_rep},
   {"reverse", str_reverse},
+  {"split", str_split},
   {"sub", str_sub},
   {"upper", str_upper},
   {"pack", str_pack},
@@ -1711,11 +2617,40 @@ static void createmetatable (lua_State *L) {
 }
 
 
+/*
+** Creates the table of compiled patterns.
+*/
+static void createpatterns (lua_State *L) {
+  lua_newtable(L);
+  lua_createtable(L, 0, 1);  /* its metatable */
+  lua_pushliteral(L, "v");
+  lua_setfield(L, -2, "__mode");  /* metatable.__mode = "v" */
+  lua_setmetatable(L, -2);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, LUA_REGISTRYINDEX, LUA_PATTERNS_TABLE);
+}
+
+
+/*
+** Creates the table of compiled formats.
+*/
+static void createformats (lua_State *L) {
+  lua_newtable(L);
+  lua_createtable(L, 0, 1);  /* its metatable */
+  lua_pushliteral(L, "v");
+  lua_setfield(L, -2, "__mode");  /* metatable.__mode = "v" */
+  lua_setmetatable(L, -2);
+}
+
+
 /*
 ** Open string library
 */
 LUAMOD_API int luaopen_string (lua_State *L) {
-  luaL_newlib(L, strlib);
+  luaL_newlibtable(L, strlib);
+  createpatterns(L);
+  createformats(L);
+  luaL_setfuncs(L, strlib, 2);  /* all functions share those tables */
   createmetatable(L);
   return 1;
 }
@@ -27,6 +27,11 @@
 // 非负整数保存在数组部分
 #include <math.h>
 #include <limits.h>
+#include <string.h>
+
+#if defined(LUA_USE_GROUPHASH) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "lua.h"
 
@@ -63,6 +68,35 @@
 // 类型是unsigned int
 #define MAXHBITS	(MAXABITS - 1)
 
+
+/*
+** Hash parts with at least LUAI_MIGRATESIZE nodes are not rebuilt in one
+** go when the table is resized: the new hash part starts empty and each
+** insertion of a new key moves LUAI_MIGRATESTEP nodes of the old one into
+** it (see 'migrate').
+*/
+#if !defined(LUAI_MIGRATESIZE)
+#define LUAI_MIGRATESIZE	(1 << 15)
+#endif
+
+#if !defined(LUAI_MIGRATESTEP)
+#define LUAI_MIGRATESTEP	16
+#endif
+
+
+/*
+** When a table is frozen, its hash part may grow up to 2^LUAI_FROZENSPREAD
+** times its needed size to get each key into its main position (see
+** 'luaH_freeze').
+*/
+#if !defined(LUAI_FROZENSPREAD)
+#define LUAI_FROZENSPREAD	2
+#endif
+
+
+#define checkfrozen(L,t)  \
+  { if (isfrozen(t)) luaG_runerror(L, "attempt to modify a frozen table"); }
+
 // #define gnode(t,i)  (&(t)->node[i])
 // gnode的定义如上，用来返回t的哈希部分的第i个节点，此处的i就是哈希部分0-size-1的整数值
 // 这里的sizenode(t)是返回t的哈希部分的尺寸
@@ -94,16 +128,46 @@
 
 
 // 宏定义一个虚拟节点，用于空哈希部分的元素
+#if !defined(LUA_USE_GROUPHASH)
 #define dummynode		(&dummynode_)
+#else
+#define dummynode		(&dummynode_.node)
+#endif
 
 // 此Node数据结构是lobject.h中定义的table的哈希部分节点的数据结构
 // value部分是TValue类型，NILCONSTANT的定义为  #define NILCONSTANT {NULL}, LUA_TNIL
 // key部分是TKey类型。nk->TValuefields = NILCONSTANT  nk->next = 0
+#if !defined(LUA_USE_GROUPHASH)
+
 static const Node dummynode_ = {
   {NILCONSTANT},  /* value */
   {{NILCONSTANT, 0}}  /* key */
 };
 
+#else
+
+/* number of slots probed at once (one control byte each) */
+#define GROUPSIZE	16
+
+/* control bytes: 0-127 are the top bits of the hash of a used slot */
+#define CTRL_EMPTY	0x80	/* free slot */
+#define CTRL_SENTINEL	0xFE	/* padding after the slots of small tables */
+
+#define E_	CTRL_EMPTY
+
+/* dummy node must be followed by its control bytes, as any hash part */
+static const struct {
+  Node node;
+  lu_byte ctrl[GROUPSIZE];
+} dummynode_ = {
+  {{NILCONSTANT}, {{NILCONSTANT, 0}}},
+  {E_, E_, E_, E_, E_, E_, E_, E_, E_, E_, E_, E_, E_, E_, E_, E_}
+};
+
+#undef E_
+
+#endif
+
 
 /*
 ** Hash for floating-point numbers.
@@ -149,6 +213,8 @@ static int l_hashfloat (lua_Number n) {
 #endif
 
 
+#if !defined(LUA_USE_GROUPHASH)
+
 /*
 ** returns the 'main' position of an element in a table (that is, the index
 ** of its hash value)
@@ -194,6 +260,181 @@ static Node *mainposition (const Table *t, const TValue *key) {
   }
 }
 
+#else
+
+/*
+** {=============================================================
+** Open addressing
+** ==============================================================
+** The hash part is an array of 'sizenode(t)' nodes followed by one
+** control byte per node (at least GROUPSIZE of them, see 'ctrlsize').
+** A key hashes to a group of GROUPSIZE consecutive slots; the bytes
+** of a group are compared all at once against the top 7 bits of the
+** hash, so a search only looks at the keys of the candidate slots.
+** If the group has no free slot, the search goes on to other groups
+** (triangular probing, which visits every group). A slot, once used,
+** stays used until the next rehash, like the nodes of a chained table
+** (a key whose value is nil is a tombstone). 'lastfree' counts how
+** many slots can still be used before a rehash: 'lastfree - node' is
+** that number, so the load factor stays below 7/8.
+*/
+
+#define gctrl(t)	cast(lu_byte *, gnode(t, sizenode(t)))
+
+#define ctrlsize(size)	((size) < GROUPSIZE ? GROUPSIZE : (size))
+
+#define ngroups(t)	(sizenode(t) < GROUPSIZE ? 1 : sizenode(t) / GROUPSIZE)
+
+/* control byte for hash 'h' (its first group comes from the low bits) */
+#define ctrlbyte(h)	cast_byte((h) >> 25)
+
+/* maximum number of used slots in a hash part with 'size' slots */
+#define maxfill(size)	((size) - (size) / 8)
+
+/* size of a hash part with 'size' slots, with its control bytes */
+#define nodevecsize(size)  ((size) * sizeof(Node) + ctrlsize(size))
+
+
+#if defined(__SSE2__)
+
+/* bit 'i' of the result is set iff byte 'i' of group 'c' is 'b' */
+#define matchbyte(c,b)  cast(unsigned int, _mm_movemask_epi8(_mm_cmpeq_epi8( \
+	_mm_loadu_si128(cast(const __m128i *, (c))), _mm_set1_epi8(cast(char, b)))))
+
+#else
+
+static unsigned int matchbyte (const lu_byte *c, int b) {
+  unsigned int m = 0;
+  int i;
+  for (i = 0; i < GROUPSIZE; i++) {
+    if (c[i] == b)
+      m |= 1u << i;
+  }
+  return m;
+}
+
+#endif
+
+
+#if defined(__GNUC__)
+#define lowbit(x)	__builtin_ctz(x)
+#else
+static int lowbit (unsigned int x) {
+  int i = 0;
+  while (!(x & 1u)) { x >>= 1; i++; }
+  return i;
+}
+#endif
+
+
+/*
+** final mix of a hash: the original hashes of integers and pointers
+** have poor high and low bits
+*/
+static unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  return h ^ (h >> 16);
+}
+
+
+static unsigned int hashkey (const TValue *key) {
+  unsigned int h;
+  switch (ttype(key)) {
+    case LUA_TNUMINT: h = cast(unsigned int, l_castS2U(ivalue(key))); break;
+    case LUA_TNUMFLT: h = cast(unsigned int, l_hashfloat(fltvalue(key))); break;
+    case LUA_TSHRSTR: h = tsvalue(key)->hash; break;
+    case LUA_TLNGSTR: h = luaS_hashlongstr(tsvalue(key)); break;
+    case LUA_TBOOLEAN: h = cast(unsigned int, bvalue(key)); break;
+    case LUA_TLIGHTUSERDATA: h = point2uint(pvalue(key)); break;
+    case LUA_TLCF: h = point2uint(fvalue(key)); break;
+    default:
+      lua_assert(!ttisdeadkey(key));
+      h = point2uint(gcvalue(key));
+      break;
+  }
+  return mixhash(h);
+}
+
+
+/* state of a search for the slots whose control byte matches a hash */
+typedef struct Probe {
+  const lu_byte *ctrl;  /* control bytes of the table */
+  unsigned int gmask;  /* number of groups - 1 */
+  unsigned int g;  /* current group */
+  unsigned int step;  /* number of groups already visited */
+  unsigned int bits;  /* matching slots of current group not visited yet */
+  int hasempty;  /* true if current group has a free slot */
+  int cb;  /* control byte being searched */
+} Probe;
+
+
+static void loadgroup (Probe *p) {
+  const lu_byte *c = p->ctrl + p->g * GROUPSIZE;
+  p->bits = matchbyte(c, p->cb);
+  p->hasempty = (matchbyte(c, CTRL_EMPTY) != 0);
+}
+
+
+/*
+** returns the next candidate node for the search 'p', or NULL when
+** no other node can hold the key (a group with a free slot ends the
+** search, as an insertion would have used that slot)
+*/
+static Node *nextmatch (const Table *t, Probe *p) {
+  for (;;) {
+    if (p->bits != 0) {
+      int i = lowbit(p->bits);
+      p->bits &= p->bits - 1;
+      return gnode(t, p->g * GROUPSIZE + i);
+    }
+    if (p->hasempty || p->step == p->gmask)
+      return NULL;
+    p->step++;
+    p->g = (p->g + p->step) & p->gmask;
+    loadgroup(p);
+  }
+}
+
+
+static Node *firstmatch (const Table *t, unsigned int h, Probe *p) {
+  p->ctrl = gctrl(t);
+  p->gmask = ngroups(t) - 1;
+  p->g = h & p->gmask;
+  p->step = 0;
+  p->cb = ctrlbyte(h);
+  loadgroup(p);
+  return nextmatch(t, p);
+}
+
+
+/*
+** takes the first free slot in the probe sequence of hash 'h' (there
+** must be one, see 'maxfill')
+*/
+static Node *getfreepos (Table *t, unsigned int h) {
+  lu_byte *ctrl = gctrl(t);
+  unsigned int gmask = ngroups(t) - 1;
+  unsigned int g = h & gmask;
+  unsigned int step = 0;
+  unsigned int empty;
+  int i;
+  while ((empty = matchbyte(ctrl + g * GROUPSIZE, CTRL_EMPTY)) == 0) {
+    lua_assert(step < gmask);
+    step++;
+    g = (g + step) & gmask;
+  }
+  i = g * GROUPSIZE + lowbit(empty);
+  ctrl[i] = ctrlbyte(h);
+  return gnode(t, i);
+}
+
+/* }============================================================= */
+
+#endif
+
 
 /*
 ** returns the index for 'key' if 'key' is an appropriate key to live in
@@ -210,6 +451,352 @@ static unsigned int arrayindex (const TValue *key) {
 }
 
 
+/*
+** {=============================================================
+** Shapes
+** ==============================================================
+*/
+
+static void setnodevector (lua_State *L, Table *t, unsigned int size);
+
+
+/*
+** returns the position of 'key' in the keys of shape 's', or -1 if
+** it is not there
+*/
+static int shapefind (const Shape *s, const TString *key) {
+  if (s->nkeys <= SHAPELINEAR) {
+    int i;
+    for (i = 0; i < s->nkeys; i++) {
+      if (s->keys[i] == key)
+        return i;
+    }
+  }
+  else {
+    const lu_byte *index = shapeindex(s);
+    int size = twoto(s->lsizeindex);
+    int i = lmod(key->hash, size);
+    while (index[i] != 0) {  /* linear probing */
+      if (s->keys[index[i] - 1] == key)
+        return index[i] - 1;
+      i = lmod(i + 1, size);
+    }
+  }
+  return -1;
+}
+
+
+/*
+** creates the shape with the keys of 'parent' plus 'key', and links
+** it as a transition from 'parent'
+*/
+static Shape *newshape (lua_State *L, Shape *parent, TString *key) {
+  int n = parent->nkeys + 1;
+  int lsi = (n > SHAPELINEAR) ? luaO_ceillog2(n) + 1 : 0;  /* index >= 2n */
+  GCObject *o = luaC_newobj(L, LUA_TSHAPE, shapesize(n, lsi));
+  Shape *s = gco2shape(o);
+  s->nkeys = cast_byte(n);
+  s->lsizeindex = cast_byte(lsi);
+  s->parent = parent;
+  s->child = NULL;
+  memcpy(s->keys, parent->keys, (n - 1) * sizeof(TString *));
+  s->keys[n - 1] = key;
+  if (n > SHAPELINEAR) {  /* build index */
+    lu_byte *index = shapeindex(s);
+    int size = twoto(lsi);
+    int i;
+    memset(index, 0, size);
+    for (i = 0; i < n; i++) {
+      int j = lmod(s->keys[i]->hash, size);
+      while (index[j] != 0)
+        j = lmod(j + 1, size);
+      index[j] = cast_byte(i + 1);
+    }
+  }
+  s->sibling = parent->child;
+  parent->child = s;
+  return s;
+}
+
+
+/*
+** adds short string 'key' to shaped table 't' and returns its (nil)
+** field. 'fields' grows before the table moves to the new shape, so
+** that a collection or an error in between leaves 't' consistent.
+*/
+static TValue *shapenewkey (lua_State *L, Table *t, TString *key) {
+  Shape *s = t->shape;
+  Shape *c;
+  int n = s->nkeys;
+  lua_assert(n < LUAI_MAXSHAPEKEYS);
+  if (n == t->sizefields) {  /* no room for another field? */
+    int size = (n < 4) ? 4 : 2 * n;
+    if (size > LUAI_MAXSHAPEKEYS)
+      size = LUAI_MAXSHAPEKEYS;
+    luaM_reallocvector(L, t->fields, t->sizefields, size, TValue);
+    t->sizefields = cast_byte(size);
+  }
+  for (c = s->child; c != NULL; c = c->sibling) {  /* existing transition? */
+    if (c->keys[n] == key)
+      break;
+  }
+  if (c == NULL)
+    c = newshape(L, s, key);
+  setnilvalue(&t->fields[n]);
+  t->shape = c;
+  luaC_objbarrier(L, t, c);
+  return &t->fields[n];
+}
+
+
+/* number of non-nil fields in shaped table 't' */
+static unsigned int numusefields (const Table *t) {
+  unsigned int n = 0;
+  int i;
+  for (i = 0; i < t->shape->nkeys; i++) {
+    if (!ttisnil(&t->fields[i]))
+      n++;
+  }
+  return n;
+}
+
+
+/*
+** moves the fields of shaped table 't' to a new hash part with room
+** for 'size' entries; the table stays a regular one from then on
+*/
+static void unshape (lua_State *L, Table *t, unsigned int size) {
+  Shape *s = t->shape;
+  TValue *fields = t->fields;
+  int i;
+  lua_assert(isdummy(t) && size >= numusefields(t));
+  setnodevector(L, t, size);
+  t->shape = NULL;
+  t->fields = NULL;
+  for (i = 0; i < s->nkeys; i++) {
+    if (!ttisnil(&fields[i])) {
+      TValue k;
+      setsvalue(L, &k, s->keys[i]);
+      setobjt2t(L, luaH_set(L, t, &k), &fields[i]);
+    }
+  }
+  luaM_freearray(L, fields, t->sizefields);
+  t->sizefields = 0;
+}
+
+
+/*
+** create the root of all shapes (the shape of new tables)
+*/
+void luaH_init (lua_State *L) {
+  GCObject *o = luaC_newobj(L, LUA_TSHAPE, shapesize(0, 0));
+  Shape *s = gco2shape(o);
+  s->nkeys = s->lsizeindex = 0;
+  s->parent = s->child = s->sibling = NULL;
+  G(L)->emptyshape = s;
+  luaC_fix(L, o);  /* never collect the root */
+}
+
+/* }============================================================= */
+
+
+/*
+** {=============================================================
+** Unboxed arrays
+** ==============================================================
+*/
+
+/* bytes used by an unboxed array with 'n' raw slots (plus its box) */
+#define rawsize(n)	(sizeof(TValue) + cast(size_t, n) * sizeof(RawValue))
+
+
+/*
+** returns the value of 'key' if it is an integer (or a float with an
+** integral value), 0 otherwise
+*/
+static lua_Integer intkey (const TValue *key) {
+  lua_Integer k;
+  if (ttisinteger(key))
+    return ivalue(key);
+  else if (ttisfloat(key) && luaV_tointeger(key, &k, 0))
+    return k;
+  else return 0;
+}
+
+
+/* resize the unboxed array of 't' to 'size' raw slots */
+static void setrawvector (lua_State *L, Table *t, unsigned int size) {
+  if (sizeof(size) >= sizeof(size_t) &&
+      cast(size_t, size) + 1 > (MAX_SIZET - sizeof(TValue)) / sizeof(RawValue))
+    luaM_toobig(L);
+  t->array = cast(TValue *, luaM_realloc_(L, t->array,
+                              rawsize(t->sizearray), rawsize(size)));
+  t->sizearray = size;
+}
+
+
+/*
+** turns the unboxed array of 't' back into a regular array of 'TValue's
+** (with the same size)
+*/
+static void boxarray (lua_State *L, Table *t) {
+  unsigned int size = t->sizearray;
+  TValue *array = luaM_newvector(L, size, TValue);
+  RawValue *raw = rawarray(t);
+  unsigned int i;
+  lua_assert(isunboxed(t));
+  for (i = 0; i < t->nraw; i++) {
+    if (t->arraytype == LUA_TNUMFLT) {
+      setfltvalue(&array[i], raw[i].n);
+    }
+    else {
+      setivalue(&array[i], raw[i].i);
+    }
+  }
+  for (; i < size; i++)
+    setnilvalue(&array[i]);
+  luaM_freemem(L, t->array, rawsize(size));
+  t->array = array;
+  t->arraytype = LUA_TNIL;
+  t->nraw = 0;
+}
+
+
+/*
+** turns the array part of 't' into an (empty) unboxed array for values
+** of type 'tt', if it has no elements. Returns whether it did so.
+*/
+static int unboxarray (lua_State *L, Table *t, int tt) {
+  unsigned int size = t->sizearray;
+  unsigned int i;
+  if (size == 0 && !isdummy(t))
+    return 0;  /* key 1 may be in the hash part */
+  for (i = 0; i < size; i++) {
+    if (!ttisnil(&t->array[i]))
+      return 0;
+  }
+  luaM_freearray(L, t->array, size);
+  t->array = NULL;
+  t->sizearray = 0;
+  t->arraytype = cast_byte(tt);
+  t->nraw = 0;
+  setrawvector(L, t, (size > 0) ? size : 1);
+  return 1;
+}
+
+
+/*
+** doubles the size of the (full) unboxed array of 't', if no key that
+** would move to the new slots is in the hash part. Returns whether it
+** did so.
+*/
+static int growunboxed (lua_State *L, Table *t) {
+  unsigned int size = t->sizearray;
+  unsigned int i;
+  if (size > MAXASIZE / 2)
+    return 0;
+  if (!isdummy(t)) {  /* hash part may have integer keys? */
+    for (i = size + 1; i <= 2 * size; i++) {
+      if (!ttisnil(luaH_getint(t, i)))
+        return 0;
+    }
+  }
+  setrawvector(L, t, 2 * size);
+  return 1;
+}
+
+
+/*
+** Assignment 't[key] = value' for a table 't' with an unboxed array.
+** Returns 1 when done; otherwise the assignment must proceed as in a
+** regular table, whose array part (if it holds 'key') is boxed by now.
+*/
+static int setunboxed (lua_State *L, Table *t, lua_Integer key,
+                                               const TValue *value) {
+  lua_Unsigned i = l_castS2U(key) - 1;  /* 0-based position */
+  unsigned int n = t->nraw;
+  if (ttype(value) == t->arraytype) {
+    if (i == n && n == t->sizearray && !growunboxed(L, t))
+      return 0;  /* cannot append in place */
+    if (i <= n) {  /* existing element or a new last one? */
+      if (t->arraytype == LUA_TNUMFLT)
+        rawarray(t)[i].n = fltvalue(value);
+      else
+        rawarray(t)[i].i = ivalue(value);
+      if (i == n) t->nraw++;
+      return 1;
+    }
+  }
+  else if (ttisnil(value)) {
+    if (n > 0 && i == n - 1) {  /* removing the last element? */
+      t->nraw--;
+      return 1;
+    }
+    else if (i >= n)  /* no element there */
+      return (i < t->sizearray);  /* (outside the array, key may be in hash) */
+  }
+  if (i < t->sizearray)
+    boxarray(L, t);  /* leaves a hole or mixes types */
+  return 0;
+}
+
+/* }============================================================= */
+
+
+/*
+** the old hash part of a table being migrated, seen as a table of its own
+** (good enough for searches)
+*/
+static Table *oldpart (const Table *t, Table *old) {
+  lua_assert(t->oldnode != NULL);
+  old->node = t->oldnode;
+  old->lsizenode = t->lsizeold;
+  old->lastfree = old->node;  /* (anything but NULL: not a dummy) */
+  old->oldnode = NULL;
+  return old;
+}
+
+
+/*
+** returns the index of node with 'key' in the hash part of 't', or -1
+** if it is not there
+*/
+static int nodeindex (Table *t, const TValue *key) {
+#if !defined(LUA_USE_GROUPHASH)
+  Node *n = mainposition(t, key);
+  for (;;) {  /* check whether 'key' is somewhere in the chain */
+    int nx;
+    /* key may be dead already, but it is ok to use it in 'next' */
+    if (luaV_rawequalobj(gkey(n), key) ||
+          (ttisdeadkey(gkey(n)) && iscollectable(key) &&
+           deadvalue(gkey(n)) == gcvalue(key)))
+      return cast_int(n - gnode(t, 0));  /* key index in hash table */
+    nx = gnext(n);
+    if (nx == 0)
+      return -1;  /* key not found */
+    n += nx;
+  }
+#else
+  /* A removed key that the collector turned into a dead key keeps its
+     slot until the next rehash. If the same object is inserted again,
+     it goes into another slot, maybe later in the probe sequence; so a
+     live match must win over a dead one. */
+  Probe p;
+  Node *n;
+  int dead = -1;  /* index of a dead key for the same object */
+  for (n = firstmatch(t, hashkey(key), &p); n != NULL; n = nextmatch(t, &p)) {
+    if (luaV_rawequalobj(gkey(n), key))
+      return cast_int(n - gnode(t, 0));  /* key index in hash table */
+    /* key may be dead already, but it is ok to use it in 'next' */
+    else if (dead < 0 && ttisdeadkey(gkey(n)) && iscollectable(key) &&
+             deadvalue(gkey(n)) == gcvalue(key))
+      dead = cast_int(n - gnode(t, 0));
+  }
+  return dead;  /* -1 if key not found */
+#endif
+}
+
+
 /*
 ** returns the index of a 'key' for table traversals. First goes all
 ** elements in the array part, then elements in the hash part. The
@@ -229,23 +816,24 @@ static unsigned int findindex (lua_State *L, Table *t, StkId key) {
   i = arrayindex(key);
   if (i != 0 && i <= t->sizearray)  /* is 'key' inside array part? */
     return i;  /* yes; that's the index */
+  else if (isshaped(t)) {
+    int j = ttisshrstring(key) ? shapefind(t->shape, tsvalue(key)) : -1;
+    if (j < 0)
+      luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+    /* fields are numbered after array elements, in insertion order */
+    return (j + 1) + t->sizearray;
+  }
   else {
-    int nx;
-    Node *n = mainposition(t, key);
-    for (;;) {  /* check whether 'key' is somewhere in the chain */
-      /* key may be dead already, but it is ok to use it in 'next' */
-      if (luaV_rawequalobj(gkey(n), key) ||
-            (ttisdeadkey(gkey(n)) && iscollectable(key) &&
-             deadvalue(gkey(n)) == gcvalue(key))) {
-        i = cast_int(n - gnode(t, 0));  /* key index in hash table */
-        /* hash elements are numbered after array ones */
-        return (i + 1) + t->sizearray;
-      }
-      nx = gnext(n);
-      if (nx == 0)
-        luaG_runerror(L, "invalid key to 'next'");  /* key not found */
-      else n += nx;
-    }
+    Table old;
+    int j = nodeindex(t, key);
+    if (j >= 0)  /* hash elements are numbered after array ones */
+      return (j + 1) + t->sizearray;
+    else if (t->oldnode != NULL &&
+             (j = nodeindex(oldpart(t, &old), key)) >= 0)
+      /* then come the ones still in the old hash part */
+      return (j + 1) + t->sizearray + sizenode(t);
+    luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+    return 0;  /* to avoid warnings */
   }
 }
 
@@ -254,12 +842,32 @@ static unsigned int findindex (lua_State *L, Table *t, StkId key) {
 // 找到这个i之后，把i+1，就是下一个元素index，然后会把&t->array[i]放入栈顶
 int luaH_next (lua_State *L, Table *t, StkId key) {
   unsigned int i = findindex(L, t, key);  /* find original element */
-  for (; i < t->sizearray; i++) {  /* try first array part */
-    if (!ttisnil(&t->array[i])) {  /* a non-nil value? */
+  if (isunboxed(t)) {  /* elements 1..nraw, then nothing */
+    if (i < t->nraw) {
       setivalue(key, i + 1);
-      setobj2s(L, key+1, &t->array[i]);
+      setobj2s(L, key+1, luaH_getint(t, i + 1));
       return 1;
     }
+    if (i < t->sizearray) i = t->sizearray;
+  }
+  else {
+    for (; i < t->sizearray; i++) {  /* try first array part */
+      if (!ttisnil(&t->array[i])) {  /* a non-nil value? */
+        setivalue(key, i + 1);
+        setobj2s(L, key+1, &t->array[i]);
+        return 1;
+      }
+    }
+  }
+  if (isshaped(t)) {  /* then fields, in insertion order */
+    for (i -= t->sizearray; cast_int(i) < t->shape->nkeys; i++) {
+      if (!ttisnil(&t->fields[i])) {  /* a non-nil value? */
+        setsvalue2s(L, key, t->shape->keys[i]);
+        setobj2s(L, key+1, &t->fields[i]);
+        return 1;
+      }
+    }
+    return 0;  /* no more elements */
   }
   for (i -= t->sizearray; cast_int(i) < sizenode(t); i++) {  /* hash part */
     if (!ttisnil(gval(gnode(t, i)))) {  /* a non-nil value? */
@@ -268,6 +876,16 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
       return 1;
     }
   }
+  if (t->oldnode != NULL) {  /* then the old hash part */
+    for (i -= sizenode(t); cast_int(i) < sizeold(t); i++) {
+      Node *n = &t->oldnode[i];
+      if (!ttisnil(gval(n))) {  /* a non-nil value? */
+        setobj2s(L, key, gkey(n));
+        setobj2s(L, key+1, gval(n));
+        return 1;
+      }
+    }
+  }
   return 0;  /* no more elements */
 }
 
@@ -336,6 +954,14 @@ static unsigned int numusearray (const Table *t, unsigned int *nums) {
   unsigned int ttlg;  /* 2^lg */
   unsigned int ause = 0;  /* summation of 'nums' */
   unsigned int i = 1;  /* count to traverse all array keys */
+  if (isunboxed(t)) {  /* keys 1..nraw are all present */
+    for (lg = 0, ttlg = 1; i <= t->nraw; lg++, ttlg *= 2) {
+      unsigned int lim = (ttlg < t->nraw) ? ttlg : t->nraw;
+      nums[lg] += lim - i + 1;
+      i = lim + 1;
+    }
+    return t->nraw;
+  }
   /* traverse each slice */
   for (lg = 0, ttlg = 1; lg <= MAXABITS; lg++, ttlg *= 2) {
     unsigned int lc = 0;  /* counter */
@@ -358,12 +984,13 @@ static unsigned int numusearray (const Table *t, unsigned int *nums) {
 
 // 计算t中哈希部分的元素数量
 // 因为其中也可能存放了正整数，需要根据这里的正整数数量更新对应的nums数组元素数量
-static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
+static int numusenodes (const Node *node, int size, unsigned int *nums,
+                                                  unsigned int *pna) {
   int totaluse = 0;  /* total number of elements */
   int ause = 0;  /* elements added to 'nums' (can go to array part) */
-  int i = sizenode(t);
+  int i = size;
   while (i--) {
-    Node *n = &t->node[i];
+    const Node *n = &node[i];
     if (!ttisnil(gval(n))) {
       ause += countint(gkey(n), nums);
       totaluse++;
@@ -373,12 +1000,25 @@ static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
   return totaluse;
 }
 
+
+static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
+  int totaluse = numusenodes(t->node, sizenode(t), nums, pna);
+  if (t->oldnode != NULL)  /* count the old hash part too */
+    totaluse += numusenodes(t->oldnode, sizeold(t), nums, pna);
+  return totaluse;
+}
+
 // 对表的数组部分大小进行设置
 // 函数很简单先申请出来size个节点的内存空间,然后在循环里面对size个元素进行初始化设置,主要操作就是把array部分的每一个节点都设置为NULL
 // 然后把数组部分长度的sizearray字段设置为size就好了
 // luaM_reallocvector这个函数是在lmem.h中定义的，到时候在分析
 static void setarrayvector (lua_State *L, Table *t, unsigned int size) {
   unsigned int i;
+  if (isunboxed(t)) {  /* raw slots past 'nraw' need no initialization */
+    lua_assert(size >= t->nraw);
+    setrawvector(L, t, size);
+    return;
+  }
   luaM_reallocvector(L, t->array, t->sizearray, size, TValue);
   for (i=t->sizearray; i<size; i++)
      setnilvalue(&t->array[i]);
@@ -404,27 +1044,80 @@ static void setarrayvector (lua_State *L, Table *t, unsigned int size) {
 // setnilvalue(gval(n));  让n的i_val字段设为NULL
 // 然后再对t的lsizenode和lastfree设置就完成了哈希部分的初始化
 // 此处lastfree指向的是size节点，也就是哈希部分的下一个节点
+/* empties the 'size' nodes of the (non-dummy) hash part of 't' */
+static void clearnodes (Table *t, unsigned int size) {
+  unsigned int i;
+#if defined(LUA_USE_GROUPHASH)
+  memset(t->node + size, CTRL_EMPTY, size);  /* control bytes */
+  memset(cast(lu_byte *, t->node + size) + size, CTRL_SENTINEL,
+         ctrlsize(size) - size);
+#endif
+  for (i = 0; i < size; i++) {
+    Node *n = gnode(t, i);
+    gnext(n) = 0;
+    setnilvalue(wgkey(n));
+    setnilvalue(gval(n));
+  }
+#if !defined(LUA_USE_GROUPHASH)
+  t->lastfree = gnode(t, size);  /* all positions are free */
+#else
+  t->lastfree = gnode(t, maxfill(size));  /* number of usable slots */
+#endif
+  t->status &= cast_byte(~DIRTYBIT);
+}
+
+
 static void setnodevector (lua_State *L, Table *t, unsigned int size) {
   if (size == 0) {  /* no elements to hash part? */
     t->node = cast(Node *, dummynode);  /* use common 'dummynode' */
     t->lsizenode = 0;
     t->lastfree = NULL;  /* signal that it is using dummy node */
+    t->status &= cast_byte(~DIRTYBIT);
   }
   else {
-    int i;
     int lsize = luaO_ceillog2(size);
+#if defined(LUA_USE_GROUPHASH)
+    if (cast(unsigned int, maxfill(twoto(lsize))) < size)
+      lsize++;  /* keep load factor below 'maxfill' */
+#endif
     if (lsize > MAXHBITS)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
+#if !defined(LUA_USE_GROUPHASH)
     t->node = luaM_newvector(L, size, Node);
-    for (i = 0; i < (int)size; i++) {
-      Node *n = gnode(t, i);
-      gnext(n) = 0;
-      setnilvalue(wgkey(n));
-      setnilvalue(gval(n));
-    }
+#else
+    if (sizeof(size) >= sizeof(size_t) &&  /* (see 'luaM_reallocv') */
+        cast(size_t, size) + 1 > (MAX_SIZET - GROUPSIZE) / (sizeof(Node) + 1))
+      luaM_toobig(L);
+    t->node = cast(Node *, luaM_malloc(L, nodevecsize(size)));
+#endif
     t->lsizenode = cast_byte(lsize);
-    t->lastfree = gnode(t, size);  /* all positions are free */
+    clearnodes(t, size);
+  }
+}
+
+
+/* returns a copy of hash part 'node', with 'size' nodes */
+static Node *copynodevector (lua_State *L, const Node *node, int size) {
+#if !defined(LUA_USE_GROUPHASH)
+  size_t sz = cast(size_t, size) * sizeof(Node);
+#else
+  size_t sz = nodevecsize(cast(size_t, size));
+#endif
+  Node *n = cast(Node *, luaM_malloc(L, sz));
+  memcpy(n, node, sz);
+  return n;
+}
+
+
+/* free a hash part with 'size' nodes (0 for the dummy node) */
+static void freenodevector (lua_State *L, Node *node, int size) {
+  if (size > 0) {  /* not the dummy node? */
+#if !defined(LUA_USE_GROUPHASH)
+    luaM_freearray(L, node, cast(size_t, size));
+#else
+    luaM_freemem(L, node, nodevecsize(cast(size_t, size)));
+#endif
   }
 }
 
@@ -432,18 +1125,58 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
 // 首先保存一下之前的oldasize，oldhsize（allocsizenode返回以2为底的散列表大小的对数值）
 // 然后判断大小做出相应的逻辑，这里要注意一下，如果(nasize < oldasize)，则会把多出来的数组位置的value设为nil（调用luaH_setint），然后收缩数组部分
 // 对于哈希部分来说，从后面向前面遍历，重新插入一下哈希部分
-void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
-                                          unsigned int nhsize) {
+/*
+** resizes 't'; a large hash part is moved to the new one gradually
+** (see 'migrate') only if 'gradual' is true
+*/
+static void resize (lua_State *L, Table *t, unsigned int nasize,
+                    unsigned int nhsize, int gradual) {
   unsigned int i;
   int j;
   unsigned int oldasize = t->sizearray;
-  int oldhsize = allocsizenode(t);
-  Node *nold = t->node;  /* save old hash ... */
+  int oldhsize;
+  Node *nold;
+  Node *mold;  /* pending migration, finished here */
+  int moldsize = 0;
+  if (isunboxed(t) && (nasize < t->nraw || nasize == 0)) {
+    boxarray(L, t);  /* elements will not fit */
+    oldasize = t->sizearray;
+  }
+  if (isshaped(t)) {
+    if (nasize >= oldasize && nhsize <= LUAI_MAXSHAPEKEYS) {  /* keep shape? */
+      if (nasize > oldasize)
+        setarrayvector(L, t, nasize);
+      if (nhsize > t->sizefields) {  /* make room for the expected fields */
+        luaM_reallocvector(L, t->fields, t->sizefields, nhsize, TValue);
+        t->sizefields = cast_byte(nhsize);
+      }
+      return;
+    }
+    unshape(L, t, numusefields(t));  /* go on with a regular table */
+  }
+  oldhsize = allocsizenode(t);
+  nold = t->node;  /* save old hash ... */
+  if (gradual && oldhsize >= LUAI_MIGRATESIZE && nasize == oldasize &&
+      t->oldnode == NULL) {  /* large hash part? */
+    lu_byte lsize = t->lsizenode;
+    setnodevector(L, t, nhsize);  /* start with an empty hash part... */
+    t->oldnode = nold;  /* ...and move the old one into it gradually */
+    t->lsizeold = lsize;
+    t->oldpos = cast(unsigned int, oldhsize);
+    return;
+  }
   if (nasize > oldasize)  /* array part must grow? */
     setarrayvector(L, t, nasize);
   /* create new hash part with appropriate size */
   setnodevector(L, t, nhsize);
-  if (nasize < oldasize) {  /* array part must shrink? */
+  mold = t->oldnode;
+  if (mold != NULL) {  /* its elements will be re-inserted too */
+    moldsize = sizeold(t);
+    t->oldnode = NULL;
+  }
+  if (nasize < oldasize && isunboxed(t))
+    setarrayvector(L, t, nasize);  /* shrink it; no element is lost */
+  else if (nasize < oldasize) {  /* array part must shrink? */
     t->sizearray = nasize;
     /* re-insert elements from vanishing slice */
     for (i=nasize; i<oldasize; i++) {
@@ -462,8 +1195,20 @@ void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
       setobjt2t(L, luaH_set(L, t, gkey(old)), gval(old));
     }
   }
-  if (oldhsize > 0)  /* not the dummy node? */
-    luaM_freearray(L, nold, cast(size_t, oldhsize)); /* free old hash */
+  freenodevector(L, nold, oldhsize);  /* free old hash */
+  for (j = moldsize - 1; j >= 0; j--) {  /* same for a migrating part */
+    Node *old = mold + j;
+    if (!ttisnil(gval(old)))
+      setobjt2t(L, luaH_set(L, t, gkey(old)), gval(old));
+  }
+  if (mold != NULL)
+    freenodevector(L, mold, moldsize);
+}
+
+
+void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
+                                          unsigned int nhsize) {
+  resize(L, t, nasize, nhsize, 1);
 }
 
 // 重新调整数组部分大小
@@ -492,6 +1237,8 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   na = numusearray(t, nums);  /* count keys in array part */
   totaluse = na;  /* all those keys are integer keys */
   totaluse += numusehash(t, nums, &na);  /* count keys in hash part */
+  if (isshaped(t))
+    totaluse += numusefields(t);  /* count fields (never integer keys) */
   /* count extra key */
   na += countint(ek, nums);
   totaluse++;
@@ -502,6 +1249,79 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
 }
 
 
+#if !defined(LUA_USE_GROUPHASH)
+/* number of keys in the hash part of 't' out of their main positions */
+static unsigned int misplaced (const Table *t) {
+  unsigned int n = 0;
+  int i;
+  for (i = 0; i < allocsizenode(t); i++) {
+    Node *nd = gnode(t, i);
+    if (!ttisnil(gval(nd)) && mainposition(t, gkey(nd)) != nd)
+      n++;
+  }
+  return n;
+}
+#endif
+
+
+/* true if no value (or key) in 't' is a collectable object */
+static int isplaintable (const Table *t) {
+  unsigned int i;
+  int j;
+  for (i = 0; i < nboxed(t); i++) {
+    if (iscollectable(&t->array[i]))
+      return 0;
+  }
+  for (j = 0; j < nfields(t); j++) {  /* (keys are in the shape) */
+    if (iscollectable(&t->fields[j]))
+      return 0;
+  }
+  for (j = 0; j < allocsizenode(t); j++) {
+    Node *n = gnode(t, j);
+    if (!ttisnil(gval(n)) && (iscollectable(gval(n)) ||
+                              iscollectable(gkey(n))))
+      return 0;
+  }
+  return 1;
+}
+
+
+/*
+** Makes 't' read-only. Its hash part is rebuilt first, without dead
+** entries or a pending migration. In that rebuild, the hash part may
+** grow (up to 2^LUAI_FROZENSPREAD times) until every key is in its main
+** position, so that searches for keys in the table look at one node
+** only. A frozen table that refers to no collectable object is not
+** traversed by the collector.
+*/
+void luaH_freeze (lua_State *L, Table *t) {
+  if (isfrozen(t))
+    return;
+  if (!isshaped(t)) {  /* (a shape is already compact) */
+    unsigned int asize;
+    unsigned int na;
+    unsigned int nums[MAXABITS + 1];
+    unsigned int nh;
+    int i;
+    for (i = 0; i <= MAXABITS; i++) nums[i] = 0;
+    na = numusearray(t, nums);
+    nh = na;
+    nh += numusehash(t, nums, &na);
+    asize = computesizes(nums, &na);
+    nh -= na;  /* keys that stay in the hash part */
+    resize(L, t, asize, nh, 0);
+#if !defined(LUA_USE_GROUPHASH)
+    for (i = 1; i <= LUAI_FROZENSPREAD && misplaced(t) > 0 &&
+                luaO_ceillog2(nh) + i <= MAXHBITS; i++)
+      resize(L, t, asize, nh << i, 0);
+#endif
+  }
+  t->status = FROZENBIT;
+  if (isplaintable(t))
+    t->status |= PLAINBIT;
+}
+
+
 
 /*
 ** }=============================================================
@@ -518,23 +1338,149 @@ Table *luaH_new (lua_State *L) {
   t->flags = cast_byte(~0);
   t->array = NULL;
   t->sizearray = 0;
+  t->arraytype = LUA_TNIL;
+  t->nraw = 0;
+  t->oldnode = NULL;
+  t->lenhint = 0;
+  t->status = 0;
+  t->shape = G(L)->emptyshape;  /* new tables start shaped */
+  t->fields = NULL;
+  t->sizefields = 0;
   setnodevector(L, t, 0);
   return t;
 }
 
+/*
+** removes all entries from table 't' but keeps the memory of its array
+** and hash parts (and its metatable), ready to be filled again
+*/
+void luaH_clear (lua_State *L, Table *t) {
+  unsigned int i;
+  checkfrozen(L, t);
+  if (isunboxed(t))
+    t->nraw = 0;
+  else {
+    for (i = 0; i < t->sizearray; i++)
+      setnilvalue(&t->array[i]);
+  }
+  if (isshaped(t))
+    t->shape = G(L)->emptyshape;  /* (never collected; no barrier needed) */
+  else if (!isdummy(t))
+    clearnodes(t, sizenode(t));
+  if (t->oldnode != NULL) {  /* drop a pending migration */
+    freenodevector(L, t->oldnode, sizeold(t));
+    t->oldnode = NULL;
+  }
+  t->lenhint = 0;
+  t->flags = cast_byte(~0);  /* no key, so no metamethod */
+}
+
+
+/*
+** makes new (empty) table 't' a shallow copy of 'src', with the same
+** layout and metatable. Array part and node vectors are copied in bulk:
+** node links are relative offsets, so they need no fixing. Each part is
+** attached to 't' only once filled, so that 't' stays consistent if a
+** later allocation fails. ('t' is new, hence white: no barriers.)
+*/
+void luaH_copy (lua_State *L, Table *t, const Table *src) {
+  unsigned int size = src->sizearray;
+  lua_assert(t->sizearray == 0 && isdummy(t) && t->fields == NULL);
+  if (isunboxed(src)) {
+    TValue *array = cast(TValue *, luaM_malloc(L, rawsize(size)));
+    memcpy(array, src->array, rawsize(size));
+    t->array = array;
+    t->arraytype = src->arraytype;
+    t->nraw = src->nraw;
+    t->sizearray = size;
+  }
+  else if (size > 0) {
+    TValue *array = luaM_newvector(L, size, TValue);
+    memcpy(array, src->array, size * sizeof(TValue));
+    t->array = array;
+    t->sizearray = size;
+  }
+  if (isshaped(src)) {
+    int n = src->shape->nkeys;
+    if (src->sizefields > 0) {
+      TValue *fields = luaM_newvector(L, src->sizefields, TValue);
+      memcpy(fields, src->fields, n * sizeof(TValue));
+      t->fields = fields;
+      t->sizefields = src->sizefields;
+    }
+    t->shape = src->shape;
+  }
+  else {
+    if (!isdummy(src)) {
+      Node *node = copynodevector(L, src->node, sizenode(src));
+      t->lastfree = node + (src->lastfree - src->node);
+      t->node = node;
+      t->lsizenode = src->lsizenode;
+    }
+    t->shape = NULL;
+  }
+  if (src->oldnode != NULL) {  /* copy a pending migration too */
+    t->oldnode = copynodevector(L, src->oldnode, sizeold(src));
+    t->lsizeold = src->lsizeold;
+    t->oldpos = src->oldpos;
+  }
+  t->lenhint = src->lenhint;
+  t->flags = src->flags;
+  t->metatable = src->metatable;
+}
+
+
+/*
+** fills 'stats' with the size of the array part of 't', the size of its
+** hash part (the number of fields, if shaped), and the numbers of live
+** and of dead entries in the latter
+*/
+void luaH_stats (const Table *t, unsigned int *stats) {
+  unsigned int live = 0;
+  unsigned int dead = 0;
+  int i;
+  stats[0] = t->sizearray;
+  if (isshaped(t)) {
+    stats[1] = nfields(t);
+    for (i = 0; i < nfields(t); i++) {
+      if (ttisnil(&t->fields[i])) dead++;
+      else live++;
+    }
+  }
+  else {
+    int nold = (t->oldnode != NULL) ? sizeold(t) : 0;
+    stats[1] = allocsizenode(t) + nold;
+    for (i = 0; i < allocsizenode(t) + nold; i++) {
+      Node *n = (i < allocsizenode(t)) ? gnode(t, i)
+                                       : &t->oldnode[i - allocsizenode(t)];
+      if (!ttisnil(gval(n))) live++;
+      else if (!ttisnil(gkey(n))) dead++;
+    }
+  }
+  stats[2] = live;
+  stats[3] = dead;
+}
+
+
 // free函数用作释放table的内存，原理很简单
 // 释放一下array部分和node部分的内存和table本身的内存
 // 释放node部分内存时候先要判断一下哈希部分有没有元素
 // 下面三个函数的具体分析在lmem.h中
 void luaH_free (lua_State *L, Table *t) {
-  if (!isdummy(t))
-    luaM_freearray(L, t->node, cast(size_t, sizenode(t)));
-  luaM_freearray(L, t->array, t->sizearray);
+  freenodevector(L, t->node, allocsizenode(t));
+  if (t->oldnode != NULL)
+    freenodevector(L, t->oldnode, sizeold(t));
+  if (isunboxed(t))
+    luaM_freemem(L, t->array, rawsize(t->sizearray));
+  else
+    luaM_freearray(L, t->array, t->sizearray);
+  luaM_freearray(L, t->fields, t->sizefields);
   luaM_free(L, t);
 }
 
 // getfreepos的作用就是从哈希部分的后面开始找可以用的空闲节点,没有找到的话就返回NULL重新哈希
 // 其实看到看到这里也明白了,lua里面的哈希填充是从后面开始的
+#if !defined(LUA_USE_GROUPHASH)
 static Node *getfreepos (Table *t) {
   if (!isdummy(t)) {
     while (t->lastfree > t->node) {
@@ -545,6 +1491,7 @@ static Node *getfreepos (Table *t) {
   }
   return NULL;  /* could not find a free place */
 }
+#endif
 
 
 
@@ -553,7 +1500,8 @@ static Node *getfreepos (Table *t) {
 ** position is free. If not, check whether colliding node is in its main
 ** position or not: if it is not, move colliding node to an empty place and
 ** put new key in its main position; otherwise (colliding node is in its main
-** position), new key goes to an empty position.
+** position), new key goes to an empty position. Returns NULL when there is
+** no free position.
 */
 // 在插入一个新的key的时候首先判断key是不是NULL，是的话就报错
 // 然后接着判断，如果是数字，若是未定义数字也错误返回
@@ -575,28 +1523,20 @@ static Node *getfreepos (Table *t) {
 // else逻辑：
 // 将f节点插入mp节点之后
 // 然后就设置一下mp的k，并且返回mp的val，让用户操作
-TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
+static TValue *insertnode (lua_State *L, Table *t, const TValue *key) {
   Node *mp;
-  TValue aux;
-  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
-  else if (ttisfloat(key)) {
-    lua_Integer k;
-    if (luaV_tointeger(key, &k, 0)) {  /* does index fit in an integer? */
-      setivalue(&aux, k);
-      key = &aux;  /* insert it as an integer */
-    }
-    else if (luai_numisnan(fltvalue(key)))
-      luaG_runerror(L, "table index is NaN");
-  }
+#if defined(LUA_USE_GROUPHASH)
+  if (isdummy(t) || t->lastfree == t->node)  /* no usable slot left? */
+    return NULL;
+  t->lastfree--;
+  mp = getfreepos(t, hashkey(key));
+#else
   mp = mainposition(t, key);
   if (!ttisnil(gval(mp)) || isdummy(t)) {  /* main position is taken? */
     Node *othern;
     Node *f = getfreepos(t);  /* get a free place */
-    if (f == NULL) {  /* cannot find a free place? */
-      rehash(L, t, key);  /* grow table */
-      /* whatever called 'newkey' takes care of TM cache */
-      return luaH_set(L, t, key);  /* insert key into grown table */
-    }
+    if (f == NULL)  /* cannot find a free place? */
+      return NULL;
     lua_assert(!isdummy(t));
     othern = mainposition(t, gkey(mp));
     if (othern != mp) {  /* is colliding node out of its main position? */
@@ -620,6 +1560,7 @@ TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
       mp = f;
     }
   }
+#endif
   setnodekey(L, &mp->i_key, key);
   luaC_barrierback(L, t, key);
   lua_assert(ttisnil(gval(mp)));
@@ -627,15 +1568,182 @@ TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
 }
 
 
+#if !defined(LUA_USE_GROUPHASH)
+
+/* mark of live nodes not back in a chain yet (see 'compact') */
+#define UNPLACED	INT_MIN
+
+/*
+** puts the entry in node 'n' (an UNPLACED one) back into the chains of
+** the hash part of 't'. If its main position holds another UNPLACED
+** entry, the two swap places and the search goes on with the other one;
+** each swap leaves one more entry in its main position, so this ends.
+*/
+static void place (lua_State *L, Table *t, Node *n) {
+  TValue k, v;
+  TValue *slot;
+  setobj(L, &k, gkey(n));
+  setobj(L, &v, gval(n));
+  setnilvalue(wgkey(n));  /* 'n' is free now */
+  setnilvalue(gval(n));
+  gnext(n) = 0;
+  for (;;) {
+    Node *mp = mainposition(t, &k);
+    if (gnext(mp) == UNPLACED) {  /* take its place */
+      TValue k2, v2;
+      setobj(L, &k2, gkey(mp));
+      setobj(L, &v2, gval(mp));
+      setnodekey(L, &mp->i_key, &k);
+      setobj2t(L, gval(mp), &v);
+      gnext(mp) = 0;
+      setobj(L, &k, &k2);  /* go on with the entry that was there */
+      setobj(L, &v, &v2);
+    }
+    else break;
+  }
+  slot = insertnode(L, t, &k);
+  if (slot == NULL) {  /* free nodes may be above 'lastfree' */
+    t->lastfree = gnode(t, sizenode(t));
+    slot = insertnode(L, t, &k);  /* ('n' at least is free) */
+  }
+  lua_assert(slot != NULL);
+  setobj2t(L, slot, &v);
+}
+
+
+/*
+** Rebuilds the chains of the hash part of 't' in place, without the
+** dead entries (keys with nil values) that would otherwise stay in
+** them until the next rehash.
+*/
+static void compact (lua_State *L, Table *t) {
+  int size = sizenode(t);
+  int i;
+  lua_assert(!isdummy(t));
+  for (i = 0; i < size; i++) {
+    Node *n = gnode(t, i);
+    if (ttisnil(gval(n))) {  /* dead (or free) entry? */
+      setnilvalue(wgkey(n));
+      gnext(n) = 0;
+    }
+    else
+      gnext(n) = UNPLACED;
+  }
+  t->lastfree = gnode(t, size);  /* all free nodes may be used */
+  for (i = 0; i < size; i++) {
+    if (gnext(gnode(t, i)) == UNPLACED)
+      place(L, t, gnode(t, i));
+  }
+  t->status &= cast_byte(~DIRTYBIT);
+}
+
+#endif
+
+
+/*
+** moves the next LUAI_MIGRATESTEP nodes of the old hash part of 't' (the
+** last ones not moved yet) into its hash part, and frees the old part
+** once it is empty. Stops if the hash part is full; the next rehash will
+** then move what is left.
+*/
+static void migrate (lua_State *L, Table *t) {
+  int n;
+  for (n = 0; n < LUAI_MIGRATESTEP && t->oldpos > 0; n++) {
+    Node *old = &t->oldnode[t->oldpos - 1];
+    if (!ttisnil(gval(old))) {
+      TValue *slot = insertnode(L, t, gkey(old));
+      if (slot == NULL)
+        return;  /* no room */
+      setobjt2t(L, slot, gval(old));
+      setnilvalue(gval(old));
+    }
+    setnilvalue(wgkey(old));  /* old part must not match it anymore */
+    t->oldpos--;
+  }
+  if (t->oldpos == 0) {  /* done? */
+    freenodevector(L, t->oldnode, sizeold(t));
+    t->oldnode = NULL;
+  }
+}
+
+
+/*
+** creates entry 't[key]' (which must not be present), rehashing the table
+** if needed; returns its value slot
+*/
+TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
+  TValue aux;
+  TValue *slot;
+  checkfrozen(L, t);
+  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {
+    lua_Integer k;
+    if (luaV_tointeger(key, &k, 0)) {  /* does index fit in an integer? */
+      setivalue(&aux, k);
+      key = &aux;  /* insert it as an integer */
+    }
+    else if (luai_numisnan(fltvalue(key)))
+      luaG_runerror(L, "table index is NaN");
+  }
+  if (isshaped(t)) {
+    if (ttisshrstring(key) && t->shape->nkeys < LUAI_MAXSHAPEKEYS)
+      return shapenewkey(L, t, tsvalue(key));
+    if (arrayindex(key) != 0) {  /* may go to the array part? */
+      rehash(L, t, key);  /* keeps the shape if the key goes there */
+      if (!isshaped(t) || arrayindex(key) <= t->sizearray)
+        return luaH_set(L, t, key);
+    }
+    unshape(L, t, numusefields(t) + 1);  /* need a hash part */
+  }
+  if (t->oldnode != NULL)  /* resize in progress? */
+    migrate(L, t);
+#if !defined(LUA_USE_GROUPHASH)
+  if (t->status & DIRTYBIT)  /* many dead entries in the chains? */
+    compact(L, t);
+#endif
+  slot = insertnode(L, t, key);
+  if (slot == NULL) {  /* no free position? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' takes care of TM cache */
+    return luaH_set(L, t, key);  /* insert key into grown table */
+  }
+  return slot;
+}
+
+
+static const TValue *getgeneric (Table *t, const TValue *key);
+
+/* search for 'key' in the old hash part of a table being migrated */
+static const TValue *getold (const Table *t, const TValue *key) {
+  Table old;
+  return getgeneric(oldpart(t, &old), key);
+}
+
+
 /*
 ** search function for integers
 */
 // 返回key对应的i字段
 const TValue *luaH_getint (Table *t, lua_Integer key) {
   /* (1 <= key && key <= t->sizearray) */
-  if (l_castS2U(key) - 1 < t->sizearray)
-    return &t->array[key - 1];
+  if (l_castS2U(key) - 1 < t->sizearray) {
+    if (!isunboxed(t))
+      return &t->array[key - 1];
+    else if (l_castS2U(key) > t->nraw)
+      return luaO_nilobject;
+    else {  /* box the raw value */
+      TValue *box = t->array;
+      if (t->arraytype == LUA_TNUMFLT) {
+        setfltvalue(box, rawarray(t)[key - 1].n);
+      }
+      else {
+        setivalue(box, rawarray(t)[key - 1].i);
+      }
+      return box;
+    }
+  }
   else {
+#if !defined(LUA_USE_GROUPHASH)
     Node *n = hashint(t, key);
     for (;;) {  /* check whether 'key' is somewhere in the chain */
       if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
@@ -646,6 +1754,20 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
         n += nx;
       }
     }
+#else
+    unsigned int h = mixhash(cast(unsigned int, l_castS2U(key)));
+    Probe p;
+    Node *n;
+    for (n = firstmatch(t, h, &p); n != NULL; n = nextmatch(t, &p)) {
+      if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
+        return gval(n);  /* that's it */
+    }
+#endif
+    if (t->oldnode != NULL) {  /* may be in the old hash part */
+      TValue k;
+      setivalue(&k, key);
+      return getold(t, &k);
+    }
     return luaO_nilobject;
   }
 }
@@ -655,9 +1777,15 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
 ** search function for short strings
 */
 // 返回key对应的tsv字段
-const TValue *luaH_getshortstr (Table *t, TString *key) {
-  Node *n = hashstr(t, key);
+static const TValue *getshortstr (Table *t, TString *key) {
+  Node *n;
   lua_assert(key->tt == LUA_TSHRSTR);
+  if (isshaped(t)) {
+    int i = shapefind(t->shape, key);
+    return (i < 0) ? luaO_nilobject : &t->fields[i];
+  }
+#if !defined(LUA_USE_GROUPHASH)
+  n = hashstr(t, key);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     const TValue *k = gkey(n);
     if (ttisshrstring(k) && eqshrstr(tsvalue(k), key))
@@ -669,6 +1797,51 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
       n += nx;
     }
   }
+#else
+  {
+    Probe p;
+    for (n = firstmatch(t, mixhash(key->hash), &p); n != NULL;
+         n = nextmatch(t, &p)) {
+      const TValue *nk = gkey(n);
+      if (ttisshrstring(nk) && eqshrstr(tsvalue(nk), key))
+        return gval(n);  /* that's it */
+    }
+    return luaO_nilobject;  /* not found */
+  }
+#endif
+}
+
+
+/* search for short string 'key' in the old hash part of 't' (if any) */
+static const TValue *getoldshortstr (Table *t, TString *key) {
+  if (t->oldnode == NULL)
+    return luaO_nilobject;
+  else {
+    TValue ko;
+    setsvalue(cast(lua_State *, NULL), &ko, key);
+    return getold(t, &ko);
+  }
+}
+
+
+const TValue *luaH_getshortstr (Table *t, TString *key) {
+  const TValue *res = getshortstr(t, key);
+  return (res != luaO_nilobject) ? res : getoldshortstr(t, key);
+}
+
+
+/*
+** slow path of 'luaH_getcached': search for 'key' and, if it is in
+** the table, save its slot (or field) as the new hint
+*/
+const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                      unsigned int *ic) {
+  const TValue *res = getshortstr(t, key);
+  if (res == luaO_nilobject)  /* no hint for the old hash part */
+    return getoldshortstr(t, key);
+  *ic = isshaped(t) ? cast(unsigned int, res - t->fields)
+                    : cast(unsigned int, cast(Node *, res) - t->node);
+  return res;
 }
 
 
@@ -678,17 +1851,28 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
 */
 // 返回t中key对应的val值，else是在mp链表里面遍历
 static const TValue *getgeneric (Table *t, const TValue *key) {
+#if !defined(LUA_USE_GROUPHASH)
   Node *n = mainposition(t, key);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (luaV_rawequalobj(gkey(n), key))
       return gval(n);  /* that's it */
     else {
       int nx = gnext(n);
-      if (nx == 0)
-        return luaO_nilobject;  /* not found */
+      if (nx == 0) break;
       n += nx;
     }
   }
+#else
+  Probe p;
+  Node *n;
+  for (n = firstmatch(t, hashkey(key), &p); n != NULL; n = nextmatch(t, &p)) {
+    if (luaV_rawequalobj(gkey(n), key))
+      return gval(n);  /* that's it */
+  }
+#endif
+  if (t->oldnode != NULL)  /* may be in the old hash part */
+    return getold(t, key);
+  return luaO_nilobject;  /* not found */
 }
 
 
@@ -735,7 +1919,11 @@ const TValue *luaH_get (Table *t, const TValue *key) {
 */
 // 如果传进来的key已经存在于t中，那么直接返回key对应的索引，不然就新建一个key
 TValue *luaH_set (lua_State *L, Table *t, const TValue *key) {
-  const TValue *p = luaH_get(t, key);
+  const TValue *p;
+  checkfrozen(L, t);
+  if (isunboxed(t) && l_castS2U(intkey(key)) - 1 < t->sizearray)
+    boxarray(L, t);  /* entry must be writable */
+  p = luaH_get(t, key);
   if (p != luaO_nilobject)
     return cast(TValue *, p);
   else return luaH_newkey(L, t, key);
@@ -746,8 +1934,18 @@ TValue *luaH_set (lua_State *L, Table *t, const TValue *key) {
 // 此处的关键在于cell，if里面的cell是当key存在于table里面对应的key，else里面是当key不存在于table时新建的key
 // 然后调用setobj2t把cell的value和tt字段设为value相关的字段
 void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
-  const TValue *p = luaH_getint(t, key);
+  const TValue *p;
   TValue *cell;
+  checkfrozen(L, t);
+  if (isunboxed(t)) {
+    if (setunboxed(L, t, key, value))
+      return;
+  }
+  else if (key == 1 && ttisnumber(value) && unboxarray(L, t, ttype(value))) {
+    setunboxed(L, t, key, value);  /* first element of an unboxed array */
+    return;
+  }
+  p = luaH_getint(t, key);
   if (p != luaO_nilobject)
     cell = cast(TValue *, p);
   else {
@@ -759,6 +1957,33 @@ void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
 }
 
 
+/*
+** Finishes an assignment 't[key] = value' when 'slot', the result of
+** 'luaH_get(t, key)', is not a writable entry with a previous value:
+** either it is nil (absent or not), or it is the box of an unboxed array.
+** (Integer keys that may start or change an unboxed array go through
+** 'luaH_setint'.) Raises an error if 't' is frozen.
+*/
+void luaH_finishset (lua_State *L, Table *t, const TValue *key,
+                     const TValue *slot, TValue *value) {
+  lua_Integer k = intkey(key);
+  checkfrozen(L, t);
+  if (luaH_isbox(t, slot) && ttype(value) == t->arraytype) {
+    if (t->arraytype == LUA_TNUMFLT)  /* common case: replace an element */
+      rawarray(t)[k - 1].n = fltvalue(value);
+    else
+      rawarray(t)[k - 1].i = ivalue(value);
+  }
+  else if (k != 0 && (isunboxed(t) || k == 1))
+    luaH_setint(L, t, k, value);
+  else {
+    if (slot == luaO_nilobject)  /* no previous entry? */
+      slot = luaH_newkey(L, t, key);  /* create one */
+    setobj2t(L, cast(TValue *, slot), value);
+  }
+}
+
+
 static int unbound_search (Table *t, unsigned int j) {
   unsigned int i = j;  /* i is zero or a present index */
   j++;
@@ -784,13 +2009,17 @@ static int unbound_search (Table *t, unsigned int j) {
 
 
 /*
-** Try to find a boundary in table 't'. A 'boundary' is an integer index
-** such that t[i] is non-nil and t[i+1] is nil (and 0 if t[1] is nil).
+** Check whether 'j' is a boundary of table 't'.
 */
-// 获取t的size，这个接口在5.2后面被废除了
-int luaH_getn (Table *t) {
+static int isborder (Table *t, unsigned int j) {
+  return (j == 0 || !ttisnil(luaH_getint(t, j))) &&
+         ttisnil(luaH_getint(t, cast(lua_Integer, j) + 1));
+}
+
+
+static unsigned int findborder (Table *t) {
   unsigned int j = t->sizearray;
-  if (j > 0 && ttisnil(&t->array[j - 1])) {
+  if (!isunboxed(t) && j > 0 && ttisnil(&t->array[j - 1])) {
     /* there is a boundary in the array part: (binary) search for it */
     unsigned int i = 0;
     while (j - i > 1) {
@@ -801,19 +2030,47 @@ int luaH_getn (Table *t) {
     return i;
   }
   /* else must find a boundary in hash part */
-  else if (isdummy(t))  /* hash part is empty? */
+  else if (isdummy(t) && t->oldnode == NULL)  /* hash part is empty? */
     return j;  /* that is easy... */
   else return unbound_search(t, j);
 }
 
 
+/*
+** Try to find a boundary in table 't'. A 'boundary' is an integer index
+** such that t[i] is non-nil and t[i+1] is nil (and 0 if t[1] is nil).
+** The boundary found is kept in 'lenhint'. Updates to the table do not
+** maintain it, so it is checked before use; as tables are mostly grown
+** or shrunk at the end, the last boundary or one of its neighbors is
+** usually still a boundary, which makes '#t' constant time for them.
+*/
+// 获取t的size，这个接口在5.2后面被废除了
+int luaH_getn (Table *t) {
+  unsigned int h = t->lenhint;
+  if (isunboxed(t) && t->nraw < t->sizearray)
+    return t->nraw;  /* 'nraw + 1' is absent */
+  else if (isborder(t, h))
+    return h;
+  else if (h < cast(unsigned int, MAX_INT) && isborder(t, h + 1))
+    h++;  /* an element was appended */
+  else if (h > 0 && isborder(t, h - 1))
+    h--;  /* the last element was removed */
+  else
+    h = findborder(t);
+  t->lenhint = h;
+  return h;
+}
+
+
 
 #if defined(LUA_DEBUG)
 
+#if !defined(LUA_USE_GROUPHASH)
 // 返回t中key对应的mp
 Node *luaH_mainposition (const Table *t, const TValue *key) {
   return mainposition(t, key);
 }
+#endif
 
 // 检查t的哈希部分是否只有一个虚拟节点
 int luaH_isdummy (const Table *t) { return isdummy(t); }
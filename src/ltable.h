@@ -46,6 +46,33 @@
 #define isdummy(t)		((t)->lastfree == NULL)
 
 
+/* bits in 'status' */
+#define FROZENBIT	1	/* table is read-only (see 'luaH_freeze') */
+#define PLAINBIT	2	/* ...and refers to no collectable object */
+#define DIRTYBIT	4	/* hash part has many dead entries */
+
+#define isfrozen(t)	((t)->status & FROZENBIT)
+#define isplain(t)	((t)->status & PLAINBIT)
+
+
+/*
+** The collector sets DIRTYBIT in tables where more than 1/2^LUAI_DEADSHIFT
+** of the hash nodes hold dead entries (keys with nil values, which stay
+** in the chains); the next insertion then rebuilds the chains without
+** them (see 'compact').
+*/
+#if !defined(LUAI_DEADSHIFT)
+#define LUAI_DEADSHIFT	2
+#endif
+
+#define toomanydead(t,ndead)  \
+	((ndead) > (cast(unsigned int, sizenode(t)) >> LUAI_DEADSHIFT))
+
+
+/* size of the hash part being migrated (see 'luaH_resize') */
+#define sizeold(t)		(twoto((t)->lsizeold))
+
+
 /* allocated size for hash nodes */
 // 返回以2为底的散列表大小的对数值
 #define allocsizenode(t)	(isdummy(t) ? 0 : sizenode(t))
@@ -57,6 +84,72 @@
   (gkey(cast(Node *, cast(char *, (v)) - offsetof(Node, i_val))))
 
 
+/* maximum number of keys in a shaped table (at most 254) */
+#if !defined(LUAI_MAXSHAPEKEYS)
+#define LUAI_MAXSHAPEKEYS	32
+#endif
+
+/* shapes with more keys than this are searched through their 'index' */
+#define SHAPELINEAR	8
+
+#define isshaped(t)	((t)->shape != NULL)
+
+/* number of fields in use (including those set to nil) */
+#define nfields(t)	(isshaped(t) ? (t)->shape->nkeys : 0)
+
+/* 'index' of a shape: (1 + position in 'keys') for each key, 0 if empty */
+#define shapeindex(s)	cast(lu_byte *, &(s)->keys[(s)->nkeys])
+
+#define shapesize(n,lsi)  (offsetof(Shape, keys) + sizeof(TString *) * (n) + \
+                           ((n) > SHAPELINEAR ? twoto(lsi) : 0))
+#define sizeshape(s)	shapesize((s)->nkeys, (s)->lsizeindex)
+
+
+/*
+** Unboxed arrays. While the array part holds numbers of a single variant
+** ('arraytype', LUA_TNUMFLT or LUA_TNUMINT) at keys 1..'nraw' and nothing
+** else, it keeps them as raw values. 'array[0]' is then a box where
+** 'luaH_getint' returns the value it reads, and element 'i' lives in
+** 'rawarray(t)[i - 1]'; 'sizearray' counts the raw slots. The box is not
+** a writable entry: assignments go through 'luaH_finishset'/'luaH_setint',
+** and anything that needs a writable array slot first converts the array
+** back to 'TValue's (see 'luaH_set').
+*/
+typedef union RawValue {
+  lua_Number n;
+  lua_Integer i;
+} RawValue;
+
+#define isunboxed(t)	((t)->arraytype != LUA_TNIL)
+#define rawarray(t)	cast(RawValue *, (t)->array + 1)
+
+/* number of 'TValue's in the array part (which the collector traverses) */
+#define nboxed(t)	(isunboxed(t) ? 0 : (t)->sizearray)
+
+/* true when 'slot' (from a search in 't') is the box of an unboxed array */
+#define luaH_isbox(t,slot)	((slot) == (t)->array && isunboxed(t))
+
+
+/*
+** Search for short string 'key' using an inline cache: '*ic' is the
+** index of the hash slot (or, in a shaped table, of the field) where
+** 'key' was found the last time. When that slot still holds 'key'
+** (same table, or another table with the same layout) the search
+** costs a single comparison; otherwise, the regular search updates
+** the hint. (A rehash needs no explicit invalidation: it only makes
+** hints miss.)
+*/
+#define luaH_getcached(t,key,ic) \
+  (isshaped(t) \
+   ? (*(ic) < cast(unsigned int, (t)->shape->nkeys) && \
+      (t)->shape->keys[*(ic)] == (key) \
+        ? &(t)->fields[*(ic)] : luaH_getshortstrcached(t, key, ic)) \
+   : (*(ic) < cast(unsigned int, sizenode(t)) && \
+      ttisshrstring(gkey(gnode(t, *(ic)))) && \
+      tsvalue(gkey(gnode(t, *(ic)))) == (key) \
+        ? gval(gnode(t, *(ic))) : luaH_getshortstrcached(t, key, ic)))
+
+
 // 返回key对应的i字段
 LUAI_FUNC const TValue *luaH_getint (Table *t, lua_Integer key);
 
@@ -66,6 +159,8 @@ LUAI_FUNC void luaH_setint (lua_State *L, Table *t, lua_Integer key,
 // 返回key对应的tsv字段
 LUAI_FUNC const TValue *luaH_getshortstr (Table *t, TString *key);
 LUAI_FUNC const TValue *luaH_getstr (Table *t, TString *key);
+LUAI_FUNC const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                                unsigned int *ic);
 
 // 获取key对应的具体的值
 LUAI_FUNC const TValue *luaH_get (Table *t, const TValue *key);
@@ -75,6 +170,9 @@ LUAI_FUNC TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key);
 
 // 如果传进来的key已经存在于t中，那么直接返回key对应的索引，不然就新建一个key
 LUAI_FUNC TValue *luaH_set (lua_State *L, Table *t, const TValue *key);
+LUAI_FUNC void luaH_finishset (lua_State *L, Table *t, const TValue *key,
+                              const TValue *slot, TValue *value);
+LUAI_FUNC void luaH_init (lua_State *L);
 // 在L里创建一张空表
 LUAI_FUNC Table *luaH_new (lua_State *L);
 // 重新设置t的数组部分和哈希部分的size并且做初始化
@@ -83,6 +181,10 @@ LUAI_FUNC void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
 // 重新调整数组部分大小
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize);
 // 释放table的内存
+LUAI_FUNC void luaH_freeze (lua_State *L, Table *t);
+LUAI_FUNC void luaH_clear (lua_State *L, Table *t);
+LUAI_FUNC void luaH_stats (const Table *t, unsigned int *stats);
+LUAI_FUNC void luaH_copy (lua_State *L, Table *t, const Table *src);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
 // 实现table的递归。通过上一个键，来找到下一个键值对。
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
@@ -223,6 +223,54 @@ static int unpack (lua_State *L) {
 
 
 
+/*
+** {======================================================
+** Creation and reuse
+** =======================================================
+*/
+
+static int tnew (lua_State *L) {
+  lua_Integer na = luaL_optinteger(L, 1, 0);
+  lua_Integer nh = luaL_optinteger(L, 2, 0);
+  luaL_argcheck(L, 0 <= na && na <= INT_MAX, 1, "size out of range");
+  luaL_argcheck(L, 0 <= nh && nh <= INT_MAX, 2, "size out of range");
+  lua_createtable(L, (int)na, (int)nh);
+  return 1;
+}
+
+
+static int tclone (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_clonetable(L, 1);  /* shallow copy, with the same metatable */
+  return 1;
+}
+
+
+static int tfreeze (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_freezetable(L, 1);
+  lua_settop(L, 1);
+  return 1;  /* return the table itself */
+}
+
+
+static int tisfrozen (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_pushboolean(L, lua_isfrozen(L, 1));
+  return 1;
+}
+
+
+static int tclear (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_cleartable(L, 1);  /* keeps the memory for the next fill */
+  return 0;
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** Quicksort
@@ -434,6 +482,11 @@ static const luaL_Reg tab_funcs[] = {
   {"remove", tremove},
   {"move", tmove},
   {"sort", sort},
+  {"new", tnew},
+  {"clear", tclear},
+  {"clone", tclone},
+  {"freeze", tfreeze},
+  {"isfrozen", tisfrozen},
   {NULL, NULL}
 };
 
@@ -231,6 +231,8 @@ LUA_API void        (lua_pushnil) (lua_State *L);
 LUA_API void        (lua_pushnumber) (lua_State *L, lua_Number n);
 LUA_API void        (lua_pushinteger) (lua_State *L, lua_Integer n);
 LUA_API const char *(lua_pushlstring) (lua_State *L, const char *s, size_t len);
+LUA_API const char *(lua_pushexternalstring) (lua_State *L, const char *s,
+                                      size_t len, lua_Alloc falloc, void *ud);
 LUA_API const char *(lua_pushstring) (lua_State *L, const char *s);
 LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
@@ -253,6 +255,7 @@ LUA_API int (lua_rawgeti) (lua_State *L, int idx, lua_Integer n);
 LUA_API int (lua_rawgetp) (lua_State *L, int idx, const void *p);
 
 LUA_API void  (lua_createtable) (lua_State *L, int narr, int nrec);
+LUA_API void  (lua_clonetable) (lua_State *L, int idx);
 LUA_API void *(lua_newuserdata) (lua_State *L, size_t sz);
 LUA_API int   (lua_getmetatable) (lua_State *L, int objindex);
 LUA_API int  (lua_getuservalue) (lua_State *L, int idx);
@@ -318,6 +321,20 @@ LUA_API int (lua_isyieldable) (lua_State *L);
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
 
+/*
+** native-compiler function and options (available only in builds with
+** LUA_USE_JIT; otherwise 'lua_jit' always returns -1)
+*/
+
+#define LUA_JITOFF		0
+#define LUA_JITON		1
+#define LUA_JITISON		2
+#define LUA_JITSETTHRESHOLD	3
+#define LUA_JITCOMPILE		4
+
+LUA_API int (lua_jit) (lua_State *L, int what, int data);
+
+
 /*
 ** miscellaneous functions
 */
@@ -329,6 +346,11 @@ LUA_API int   (lua_next) (lua_State *L, int idx);
 LUA_API void  (lua_concat) (lua_State *L, int n);
 LUA_API void  (lua_len)    (lua_State *L, int idx);
 
+LUA_API void  (lua_cleartable) (lua_State *L, int idx);
+LUA_API void  (lua_freezetable) (lua_State *L, int idx);
+LUA_API int   (lua_isfrozen) (lua_State *L, int idx);
+LUA_API void  (lua_tablestats) (lua_State *L, int idx, unsigned int *stats);
+
 LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
 
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
@@ -308,7 +308,9 @@ static void PrintCode(const Proto* f)
    case iABC:
     printf("%d",a);
     if (getBMode(o)!=OpArgN) printf(" %d",ISK(b) ? (MYK(INDEXK(b))) : b);
-    if (getCMode(o)!=OpArgN) printf(" %d",ISK(c) ? (MYK(INDEXK(c))) : c);
+    if (o==OP_GETFIELD) printf(" %d",MYK(c));
+    else if (o>=OP_ADDI && o<=OP_LEI) printf(" %d",GETARG_sC(i));
+    else if (getCMode(o)!=OpArgN) printf(" %d",ISK(c) ? (MYK(INDEXK(c))) : c);
     break;
    case iABx:
     printf("%d",a);
@@ -342,8 +344,12 @@ static void PrintCode(const Proto* f)
     break;
    case OP_GETTABLE:
    case OP_SELF:
+   case OP_SELFCALL:
     if (ISK(c)) { printf("\t; "); PrintConstant(f,INDEXK(c)); }
     break;
+   case OP_GETFIELD:
+    printf("\t; "); PrintConstant(f,c);
+    break;
    case OP_SETTABLE:
    case OP_ADD:
    case OP_SUB:
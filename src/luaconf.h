@@ -44,6 +44,14 @@
 /* #define LUA_USE_C89 */
 
 
+/*
+@@ LUA_USE_GROUPHASH makes the hash part of tables use open addressing
+** with one control byte per slot, probed 16 slots at a time (with SSE2
+** when the compiler targets it), instead of a chained scatter table.
+*/
+/* #define LUA_USE_GROUPHASH */
+
+
 /*
 ** By default, Lua on Windows use (some) specific Windows features
 */
@@ -456,6 +464,14 @@
 #define lua_number2str(s,sz,n)  \
 	l_sprintf((s), sz, LUA_NUMBER_FMT, (LUAI_UACNUMBER)(n))
 
+/*
+@@ LUA_FLOAT_SHORTEST makes Lua convert floats to strings with the
+** fewest digits that read back as the same float, instead of with
+** LUA_NUMBER_FMT. (Only for doubles. It is off by default because it
+** changes results such as 'tostring(0.1 + 0.2)'.)
+*/
+/* #define LUA_FLOAT_SHORTEST */
+
 /*
 @@ lua_numbertointeger converts a float number to an integer, or
 ** returns 0 if float is not within the range of a lua_Integer.
@@ -513,6 +529,7 @@
 
 #define LUA_NUMBER_FRMLEN	""
 #define LUA_NUMBER_FMT		"%.14g"
+#define LUAI_NUMDIGITS		14	/* precision in LUA_NUMBER_FMT */
 
 #define l_mathop(op)		op
 
@@ -99,6 +99,13 @@ LUAMOD_API int (luaopen_package) (lua_State *L);
 	声明一个luaopen_package的函数，返回值是一个int数值，参数为lua_State的指针
 */
 
+#define LUA_JITLIBNAME	"jit"
+LUAMOD_API int (luaopen_jit) (lua_State *L);
+
+/*
+	声明一个luaopen_jit的函数，返回值是一个int数值，参数为lua_State的指针
+*/
+
 /* open all previous libraries */
 LUALIB_API void (luaL_openlibs) (lua_State *L);
 
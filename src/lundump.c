@@ -98,7 +98,7 @@ static TString *LoadString (LoadState *S) {
   }
   else {  /* long string */
     TString *ts = luaS_createlngstrobj(S->L, size);
-    LoadVector(S, getstr(ts), size);  /* load directly in final place */
+    LoadVector(S, rawgetstr(ts), size);  /* load directly in final place */
     return ts;
   }
 }
@@ -109,6 +109,7 @@ static void LoadCode (LoadState *S, Proto *f) {
   f->code = luaM_newvector(S->L, n, Instruction);
   f->sizecode = n;
   LoadVector(S, f->code, n);
+  luaF_newicache(S->L, f);
 }
 
 
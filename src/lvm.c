@@ -22,6 +22,7 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -35,6 +36,22 @@
 #define MAXTAGLOOP	2000
 
 
+/*
+** By default, use jump tables in the main interpreter loop on gcc
+** and compatible compilers. (Each opcode handler then ends with its
+** own indirect jump to the next handler, instead of all handlers
+** sharing the single indirect jump of a 'switch'.) Define
+** LUA_USE_JUMPTABLE as 0 to force the portable 'switch' dispatch.
+*/
+#if !defined(LUA_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define LUA_USE_JUMPTABLE	1
+#else
+#define LUA_USE_JUMPTABLE	0
+#endif
+#endif
+
+
 
 /*
 ** 'l_intfitsf' checks whether a given integer can be converted to a
@@ -65,6 +82,27 @@
 
 
 
+/*
+** Converts string 'obj' to a number in 'v'. 'luaO_str2num' needs a '\0'
+** after the string, but the bytes of a string in a buffer may be
+** followed by others (see 'luaS_extend'); so, the byte after them is
+** replaced for a while.
+*/
+static int l_strton (const TValue *obj, TValue *v) {
+  TString *ts = tsvalue(obj);
+  char *s = getstr(ts);
+  size_t l = tsslen(ts);
+  char c = s[l];
+  int res;
+  if (c == '\0')  /* (external bytes may not be writable) */
+    return (luaO_str2num(s, v) == l + 1);
+  s[l] = '\0';
+  res = (luaO_str2num(s, v) == l + 1);
+  s[l] = c;
+  return res;
+}
+
+
 /*
 ** Try to convert a value to a float. The float case is already handled
 ** by the macro 'tonumber'.
@@ -75,8 +113,7 @@ int luaV_tonumber_ (const TValue *obj, lua_Number *n) {
     *n = cast_num(ivalue(obj));
     return 1;
   }
-  else if (cvt2num(obj) &&  /* string convertible to number? */
-            luaO_str2num(svalue(obj), &v) == vslen(obj) + 1) {
+  else if (cvt2num(obj) && l_strton(obj, &v)) {  /* string convertible? */
     *n = nvalue(&v);  /* convert result of 'luaO_str2num' to a float */
     return 1;
   }
@@ -108,8 +145,7 @@ int luaV_tointeger (const TValue *obj, lua_Integer *p, int mode) {
     *p = ivalue(obj);
     return 1;
   }
-  else if (cvt2num(obj) &&
-            luaO_str2num(svalue(obj), &v) == vslen(obj) + 1) {
+  else if (cvt2num(obj) && l_strton(obj, &v)) {
     obj = &v;
     goto again;  /* convert result from 'luaO_str2num' to an integer */
   }
@@ -197,8 +233,9 @@ void luaV_finishget (lua_State *L, const TValue *t, TValue *key, StkId val,
 ** Finish a table assignment 't[key] = val'.
 ** If 'slot' is NULL, 't' is not a table.  Otherwise, 'slot' points
 ** to the entry 't[key]', or to 'luaO_nilobject' if there is no such
-** entry.  (The value at 'slot' must be nil, otherwise 'luaV_fastset'
-** would have done the job.)
+** entry.  (The value at 'slot' must be nil, the box of an unboxed
+** array, or an entry of a frozen table, otherwise 'luaV_fastset' would
+** have done the job.)
 */
 void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
                      StkId val, const TValue *slot) {
@@ -207,13 +244,10 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
     const TValue *tm;  /* '__newindex' metamethod */
     if (slot != NULL) {  /* is 't' a table? */
       Table *h = hvalue(t);  /* save 't' table */
-      lua_assert(ttisnil(slot));  /* old value must be nil */
+      lua_assert(ttisnil(slot) || luaH_isbox(h, slot) || isfrozen(h));
       tm = fasttm(L, h->metatable, TM_NEWINDEX);  /* get metamethod */
-      if (tm == NULL) {  /* no metamethod? */
-        if (slot == luaO_nilobject)  /* no previous entry? */
-          slot = luaH_newkey(L, h, key);  /* create one */
-        /* no metamethod and (now) there is an entry with given key */
-        setobj2t(L, cast(TValue *, slot), val);  /* set its new value */
+      if (tm == NULL || !ttisnil(slot)) {  /* no metamethod or old value? */
+        luaH_finishset(L, h, key, slot, val);  /* do a raw assignment */
         invalidateTMcache(h);
         luaC_barrierback(L, h, val);
         return;
@@ -243,13 +277,16 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
 ** -larger than zero if 'ls' is smaller-equal-larger than 'rs'.
 ** The code is a little tricky because it allows '\0' in the strings
 ** and it uses 'strcoll' (to respect locales) for each segments
-** of the strings.
+** of the strings. ('strcoll' needs a '\0' after each string.)
 */
-static int l_strcmp (const TString *ls, const TString *rs) {
-  const char *l = getstr(ls);
+static int l_strcmp (lua_State *L, TString *ls, TString *rs) {
+  const char *l, *r;
   size_t ll = tsslen(ls);
-  const char *r = getstr(rs);
   size_t lr = tsslen(rs);
+  luaS_flatten(L, ls, 0);
+  luaS_flatten(L, rs, 0);
+  l = getstr(ls);
+  r = getstr(rs);
   for (;;) {  /* for each segment */
     int temp = strcoll(l, r);
     if (temp != 0)  /* not equal? */
@@ -366,7 +403,7 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
   if (ttisnumber(l) && ttisnumber(r))  /* both operands are numbers? */
     return LTnum(l, r);
   else if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) < 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) < 0;
   else if ((res = luaT_callorderTM(L, l, r, TM_LT)) < 0)  /* no metamethod? */
     luaG_ordererror(L, l, r);  /* error */
   return res;
@@ -386,7 +423,7 @@ int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r) {
   if (ttisnumber(l) && ttisnumber(r))  /* both operands are numbers? */
     return LEnum(l, r);
   else if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) <= 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) <= 0;
   else if ((res = luaT_callorderTM(L, l, r, TM_LE)) >= 0)  /* try 'le' */
     return res;
   else {  /* try 'lt': */
@@ -499,9 +536,15 @@ void luaV_concat (lua_State *L, int total) {
         copy2buff(top, n, buff);  /* copy strings to buffer */
         ts = luaS_newlstr(L, buff, tl);
       }
+      else if (ttislngstring(top - n) && vslen(top - n) >= LUAI_MINBUFSTR) {
+        /* long first operand; append the others to it */
+        size_t lp = vslen(top - n);
+        ts = luaS_extend(L, tsvalue(top - n), tl);
+        copy2buff(top, n - 1, getstr(ts) + lp);
+      }
       else {  /* long string; copy strings directly to final result */
         ts = luaS_createlngstrobj(L, tl);
-        copy2buff(top, n, getstr(ts));
+        copy2buff(top, n, rawgetstr(ts));
       }
       setsvalue2s(L, top - n, ts);  /* create result */
     }
@@ -656,27 +699,31 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
 void luaV_finishOp (lua_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->u.l.base;
-  Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
+  /* interrupted instruction; calls with numbers may have quickened it
+     again while the coroutine was suspended */
+  Instruction inst = luaP_genericinst(*(ci->u.l.savedpc - 1));
   OpCode op = GET_OPCODE(inst);
   switch (op) {  /* finish its execution */
     case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_IDIV:
     case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
     case OP_MOD: case OP_POW:
     case OP_UNM: case OP_BNOT: case OP_LEN:
-    case OP_GETTABUP: case OP_GETTABLE: case OP_SELF: {
+    case OP_ADDI: case OP_SUBI:
+    case OP_GETTABUP: case OP_GETTABLE: case OP_SELF: case OP_SELFCALL:
+    case OP_GETI: case OP_GETFIELD: {
       setobjs2s(L, base + GETARG_A(inst), --L->top);
       break;
     }
-    case OP_LE: case OP_LT: case OP_EQ: {
+    case OP_LE: case OP_LT: case OP_EQ: case OP_LEI: case OP_LTI: {
       int res = !l_isfalse(L->top - 1);
       L->top--;
       if (ci->callstatus & CIST_LEQ) {  /* "<=" using "<" instead? */
-        lua_assert(op == OP_LE);
+        lua_assert(op == OP_LE || op == OP_LEI);
         ci->callstatus ^= CIST_LEQ;  /* clear mark */
         res = !res;  /* negate result */
       }
       lua_assert(GET_OPCODE(*ci->u.l.savedpc) == OP_JMP);
-      if (res != GETARG_A(inst))  /* condition failed? */
+      if (res != (GETARG_A(inst) & 1))  /* condition failed? */
         ci->u.l.savedpc++;  /* skip jump instruction */
       break;
     }
@@ -732,6 +779,7 @@ void luaV_finishOp (lua_State *L) {
 	ISK(GETARG_B(i)) ? k+INDEXK(GETARG_B(i)) : base+GETARG_B(i))
 #define RKC(i)	check_exp(getCMode(GET_OPCODE(i)) == OpArgK, \
 	ISK(GETARG_C(i)) ? k+INDEXK(GETARG_C(i)) : base+GETARG_C(i))
+#define KC(i)	(k+GETARG_C(i))
 
 
 /* execute a jump instruction */
@@ -752,8 +800,14 @@ void luaV_finishOp (lua_State *L) {
            luai_threadyield(L); }
 
 
-/* fetch an instruction and prepare its execution */
+/*
+** fetch an instruction and prepare its execution; if the function has
+** native code, run it first (it returns at the next instruction that
+** needs the interpreter)
+*/
 #define vmfetch()	{ \
+  if (luaJ_canrun(L, cl->p)) \
+    Protect(luaJ_run(L, ci, cl->p)); \
   i = *(ci->u.l.savedpc++); \
   if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) \
     Protect(luaG_traceexec(L)); \
@@ -767,15 +821,59 @@ void luaV_finishOp (lua_State *L) {
 #define vmbreak		break
 
 
+/*
+** inline cache of the current instruction (the one just fetched)
+*/
+#define icache(ci,cl)	((cl)->p->icache + pcRel((ci)->u.l.savedpc, (cl)->p))
+
+
+/*
+** Quickening: a generic arithmetic or order instruction that sees
+** operands of a specialized type (e.g., two integers) rewrites itself
+** into the variant for that type, which has a single type guard. When
+** the guard fails, the variant turns back into the generic instruction
+** and executes it (without fetching it again, so that hooks see it only
+** once). The instruction's cache counts these failures; after
+** MAXDEQUICKEN of them, the instruction stays generic.
+*/
+#define MAXDEQUICKEN	4
+
+/* writable reference to the current instruction */
+#define curinst(ci,cl)	((cl)->p->code + pcRel((ci)->u.l.savedpc, (cl)->p))
+
+#define quicken(op)  \
+  { if (*icache(ci,cl) < MAXDEQUICKEN) SET_OPCODE(*curinst(ci,cl), op); }
+
+#define dequicken(op)  \
+  { (*icache(ci,cl))++; \
+    SET_OPCODE(i, op); *curinst(ci,cl) = i; \
+    goto redispatch; }
+
+
 /*
 ** copy of 'luaV_gettable', but protecting the call to potential
-** metamethod (which can reallocate the stack)
+** metamethod (which can reallocate the stack) and using the
+** instruction's inline cache when the key is a short string
 */
 #define gettableProtected(L,t,k,v)  { const TValue *slot; \
-  if (luaV_fastget(L,t,k,slot,luaH_get)) { setobj2s(L, v, slot); } \
+  if (ttisshrstring(k) \
+      ? luaV_fastgetcached(L,t,tsvalue(k),slot,icache(ci,cl)) \
+      : luaV_fastget(L,t,k,slot,luaH_get)) { setobj2s(L, v, slot); } \
   else Protect(luaV_finishget(L,t,k,v,slot)); }
 
 
+/* OP_SELF: R(A+1) := R(B); R(A) := R(B)[RK(C)] */
+#define doself(i)  { const TValue *aux; \
+  StkId rb = RB(i); \
+  TValue *rc = RKC(i); \
+  TString *key = tsvalue(rc);  /* key must be a string */ \
+  setobjs2s(L, ra + 1, rb); \
+  if (key->tt == LUA_TSHRSTR \
+      ? luaV_fastgetcached(L, rb, key, aux, icache(ci, cl)) \
+      : luaV_fastget(L, rb, key, aux, luaH_getstr)) { setobj2s(L, ra, aux); } \
+  else Protect(luaV_finishget(L, rb, rc, ra, aux)); }
+
+
 /* same for 'luaV_settable' */
 #define settableProtected(L,t,k,v) { const TValue *slot; \
   if (!luaV_fastset(L,t,k,slot,luaH_get,v)) \
@@ -788,17 +886,23 @@ void luaV_execute (lua_State *L) {
   LClosure *cl;
   TValue *k;
   StkId base;
+#if LUA_USE_JUMPTABLE
+#include "ljumptab.h"
+#endif
   ci->callstatus |= CIST_FRESH;  /* fresh invocation of 'luaV_execute" */
  newframe:  /* reentry point when frame changes (call/return) */
   lua_assert(ci == L->ci);
   cl = clLvalue(ci->func);  /* local reference to function's closure */
   k = cl->p->k;  /* local reference to function's constant table */
   base = ci->u.l.base;  /* local copy of function's base */
+  if (ci->u.l.savedpc == cl->p->code)  /* entering the function? */
+    luaJ_hot(L, cl->p);
   /* main loop of interpreter */
   for (;;) {
     Instruction i;
     StkId ra;
     vmfetch();
+   redispatch:  /* reentry point for de-quickened instructions */
     vmdispatch (GET_OPCODE(i)) {
       vmcase(OP_MOVE) {
         setobjs2s(L, ra, RB(i));
@@ -875,17 +979,19 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_SELF) {
-        const TValue *aux;
-        StkId rb = RB(i);
-        TValue *rc = RKC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
-        setobjs2s(L, ra + 1, rb);
-        if (luaV_fastget(L, rb, key, aux, luaH_getstr)) {
-          setobj2s(L, ra, aux);
-        }
-        else Protect(luaV_finishget(L, rb, rc, ra, aux));
+        doself(i);
         vmbreak;
       }
+      vmcase(OP_SELFCALL) {
+        doself(i);  /* same as OP_SELF... */
+        if (!(L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))) {
+          i = *(ci->u.l.savedpc++);  /* ...followed by the call */
+          ra = RA(i);
+          lua_assert(GET_OPCODE(i) == OP_CALL);
+          goto l_call;
+        }
+        vmbreak;  /* with hooks, the call is fetched as usual */
+      }
       vmcase(OP_ADD) {
         TValue *rb = RKB(i);
         TValue *rc = RKC(i);
@@ -893,9 +999,11 @@ void luaV_execute (lua_State *L) {
         if (ttisinteger(rb) && ttisinteger(rc)) {
           lua_Integer ib = ivalue(rb); lua_Integer ic = ivalue(rc);
           setivalue(ra, intop(+, ib, ic));
+          quicken(OP_ADDII);
         }
         else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
           setfltvalue(ra, luai_numadd(L, nb, nc));
+          if (ttisfloat(rb) && ttisfloat(rc)) quicken(OP_ADDFF);
         }
         else { Protect(luaT_trybinTM(L, rb, rc, ra, TM_ADD)); }
         vmbreak;
@@ -907,9 +1015,11 @@ void luaV_execute (lua_State *L) {
         if (ttisinteger(rb) && ttisinteger(rc)) {
           lua_Integer ib = ivalue(rb); lua_Integer ic = ivalue(rc);
           setivalue(ra, intop(-, ib, ic));
+          quicken(OP_SUBII);
         }
         else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
           setfltvalue(ra, luai_numsub(L, nb, nc));
+          if (ttisfloat(rb) && ttisfloat(rc)) quicken(OP_SUBFF);
         }
         else { Protect(luaT_trybinTM(L, rb, rc, ra, TM_SUB)); }
         vmbreak;
@@ -921,9 +1031,11 @@ void luaV_execute (lua_State *L) {
         if (ttisinteger(rb) && ttisinteger(rc)) {
           lua_Integer ib = ivalue(rb); lua_Integer ic = ivalue(rc);
           setivalue(ra, intop(*, ib, ic));
+          quicken(OP_MULII);
         }
         else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
           setfltvalue(ra, luai_nummul(L, nb, nc));
+          if (ttisfloat(rb) && ttisfloat(rc)) quicken(OP_MULFF);
         }
         else { Protect(luaT_trybinTM(L, rb, rc, ra, TM_MUL)); }
         vmbreak;
@@ -1078,6 +1190,8 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_JMP) {
+        if (GETARG_sBx(i) < 0)  /* loop back edge? */
+          luaJ_hot(L, cl->p);
         dojump(ci, i, 0);
         vmbreak;
       }
@@ -1093,8 +1207,11 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_LT) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) quicken(OP_LTII);
         Protect(
-          if (luaV_lessthan(L, RKB(i), RKC(i)) != GETARG_A(i))
+          if (luaV_lessthan(L, rb, rc) != GETARG_A(i))
             ci->u.l.savedpc++;
           else
             donextjump(ci);
@@ -1102,8 +1219,11 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_LE) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) quicken(OP_LEII);
         Protect(
-          if (luaV_lessequal(L, RKB(i), RKC(i)) != GETARG_A(i))
+          if (luaV_lessequal(L, rb, rc) != GETARG_A(i))
             ci->u.l.savedpc++;
           else
             donextjump(ci);
@@ -1128,8 +1248,11 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_CALL) {
-        int b = GETARG_B(i);
-        int nresults = GETARG_C(i) - 1;
+        int b;
+        int nresults;
+       l_call:
+        b = GETARG_B(i);
+        nresults = GETARG_C(i) - 1;
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
         if (luaD_precall(L, ra, nresults)) {  /* C function? */
           if (nresults >= 0)
@@ -1188,6 +1311,7 @@ void luaV_execute (lua_State *L) {
         }
       }
       vmcase(OP_FORLOOP) {
+        luaJ_hot(L, cl->p);
         if (ttisinteger(ra)) {  /* integer loop? */
           lua_Integer step = ivalue(ra + 2);
           lua_Integer idx = intop(+, ivalue(ra), step); /* increment index */
@@ -1254,6 +1378,7 @@ void luaV_execute (lua_State *L) {
       }
       vmcase(OP_TFORLOOP) {
         l_tforloop:
+        luaJ_hot(L, cl->p);
         if (!ttisnil(ra + 1)) {  /* continue loop? */
           setobjs2s(L, ra, ra + 1);  /* save control variable */
            ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
@@ -1263,6 +1388,7 @@ void luaV_execute (lua_State *L) {
       vmcase(OP_SETLIST) {
         int n = GETARG_B(i);
         int c = GETARG_C(i);
+        int j;
         unsigned int last;
         Table *h;
         if (n == 0) n = cast_int(L->top - ra) - 1;
@@ -1274,9 +1400,10 @@ void luaV_execute (lua_State *L) {
         last = ((c-1)*LFIELDS_PER_FLUSH) + n;
         if (last > h->sizearray)  /* needs more space? */
           luaH_resizearray(L, h, last);  /* preallocate it at once */
-        for (; n > 0; n--) {
-          TValue *val = ra+n;
-          luaH_setint(L, h, last--, val);
+        last -= n;
+        for (j = 1; j <= n; j++) {  /* in order, so numbers may stay unboxed */
+          TValue *val = ra+j;
+          luaH_setint(L, h, last + j, val);
           luaC_barrierback(L, h, val);
         }
         L->top = ci->top;  /* correct top (in case of previous open call) */
@@ -1314,6 +1441,203 @@ void luaV_execute (lua_State *L) {
         lua_assert(0);
         vmbreak;
       }
+      vmcase(OP_GETI) {
+        StkId rb = RB(i);
+        int c = GETARG_C(i);
+        const TValue *slot;
+        if (luaV_fastget(L, rb, c, slot, luaH_getint)) {
+          setobj2s(L, ra, slot);
+        }
+        else {
+          TValue key;
+          setivalue(&key, c);
+          Protect(luaV_finishget(L, rb, &key, ra, slot));
+        }
+        vmbreak;
+      }
+      vmcase(OP_GETFIELD) {
+        StkId rb = RB(i);
+        TValue *rc = KC(i);
+        const TValue *slot;
+        lua_assert(ttisshrstring(rc));
+        if (luaV_fastgetcached(L, rb, tsvalue(rc), slot, icache(ci, cl))) {
+          setobj2s(L, ra, slot);
+        }
+        else Protect(luaV_finishget(L, rb, rc, ra, slot));
+        vmbreak;
+      }
+      vmcase(OP_ADDI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        lua_Number nb;
+        if (ttisinteger(rb)) {
+          setivalue(ra, intop(+, ivalue(rb), ic));
+        }
+        else if (tonumber(rb, &nb)) {
+          setfltvalue(ra, luai_numadd(L, nb, cast_num(ic)));
+        }
+        else {
+          TValue rc;
+          setivalue(&rc, ic);
+          Protect(luaT_trybinTM(L, rb, &rc, ra, TM_ADD));
+        }
+        vmbreak;
+      }
+      vmcase(OP_SUBI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        lua_Number nb;
+        if (ttisinteger(rb)) {
+          setivalue(ra, intop(-, ivalue(rb), ic));
+        }
+        else if (tonumber(rb, &nb)) {
+          setfltvalue(ra, luai_numsub(L, nb, cast_num(ic)));
+        }
+        else {
+          TValue rc;
+          setivalue(&rc, ic);
+          Protect(luaT_trybinTM(L, rb, &rc, ra, TM_SUB));
+        }
+        vmbreak;
+      }
+      vmcase(OP_EQI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        int res;
+        if (ttisinteger(rb))
+          res = (ivalue(rb) == ic);
+        else if (ttisfloat(rb))
+          res = luai_numeq(fltvalue(rb), cast_num(ic));
+        else
+          res = 0;  /* other values are never equal to a number */
+        if (res != GETARG_A(i))
+          ci->u.l.savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_LTI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        int swap = GETARG_A(i) & BITIMMFIRST;
+        int res;
+        if (ttisinteger(rb))
+          res = swap ? (ic < ivalue(rb)) : (ivalue(rb) < ic);
+        else if (ttisfloat(rb))
+          res = swap ? luai_numlt(cast_num(ic), fltvalue(rb))
+                     : luai_numlt(fltvalue(rb), cast_num(ic));
+        else {
+          TValue rc;
+          setivalue(&rc, ic);
+          Protect(res = swap ? luaV_lessthan(L, &rc, rb)
+                             : luaV_lessthan(L, rb, &rc));
+        }
+        if (res != (GETARG_A(i) & 1))
+          ci->u.l.savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_LEI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        int swap = GETARG_A(i) & BITIMMFIRST;
+        int res;
+        if (ttisinteger(rb))
+          res = swap ? (ic <= ivalue(rb)) : (ivalue(rb) <= ic);
+        else if (ttisfloat(rb))
+          res = swap ? luai_numle(cast_num(ic), fltvalue(rb))
+                     : luai_numle(fltvalue(rb), cast_num(ic));
+        else {
+          TValue rc;
+          setivalue(&rc, ic);
+          Protect(res = swap ? luaV_lessequal(L, &rc, rb)
+                             : luaV_lessequal(L, rb, &rc));
+        }
+        if (res != (GETARG_A(i) & 1))
+          ci->u.l.savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_ADDII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          setivalue(ra, intop(+, ivalue(rb), ivalue(rc)));
+        }
+        else dequicken(OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_SUBII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          setivalue(ra, intop(-, ivalue(rb), ivalue(rc)));
+        }
+        else dequicken(OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_MULII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          setivalue(ra, intop(*, ivalue(rb), ivalue(rc)));
+        }
+        else dequicken(OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_ADDFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          setfltvalue(ra, luai_numadd(L, fltvalue(rb), fltvalue(rc)));
+        }
+        else dequicken(OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_SUBFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          setfltvalue(ra, luai_numsub(L, fltvalue(rb), fltvalue(rc)));
+        }
+        else dequicken(OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_MULFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          setfltvalue(ra, luai_nummul(L, fltvalue(rb), fltvalue(rc)));
+        }
+        else dequicken(OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_LTII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          if ((ivalue(rb) < ivalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+        }
+        else dequicken(OP_LT);
+        vmbreak;
+      }
+      vmcase(OP_LEII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          if ((ivalue(rb) <= ivalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+        }
+        else dequicken(OP_LE);
+        vmbreak;
+      }
     }
   }
 }
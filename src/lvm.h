@@ -61,6 +61,16 @@
    : (slot = f(hvalue(t), k),  /* else, do raw access */  \
       !ttisnil(slot)))  /* result not nil? */
 
+/*
+** 'luaV_fastget' for a constant short-string key 'k', using the
+** inline cache 'ic' of the instruction (see 'luaH_getcached')
+*/
+#define luaV_fastgetcached(L,t,k,slot,ic) \
+  (!ttistable(t)  \
+   ? (slot = NULL, 0)  \
+   : (slot = luaH_getcached(hvalue(t), k, ic),  \
+      !ttisnil(slot)))
+
 /*
 ** standard implementation for 'gettable'
 */
@@ -72,8 +82,10 @@
 /*
 ** Fast track for set table. If 't' is a table and 't[k]' is not nil,
 ** call GC barrier, do a raw 't[k]=v', and return true; otherwise,
-** return false with 'slot' equal to NULL (if 't' is not a table) or
-** 'nil'. (This is needed by 'luaV_finishget'.) Note that, if the macro
+** return false with 'slot' equal to NULL (if 't' is not a table),
+** 'nil', the box of an unboxed array (which cannot be written in
+** place), or any entry of a frozen table (which cannot be written at
+** all). (This is needed by 'luaV_finishget'.) Note that, if the macro
 ** returns true, there is no need to 'invalidateTMcache', because the
 ** call is not creating a new entry.
 */
@@ -81,7 +93,8 @@
   (!ttistable(t) \
    ? (slot = NULL, 0) \
    : (slot = f(hvalue(t), k), \
-     ttisnil(slot) ? 0 \
+     ttisnil(slot) || luaH_isbox(hvalue(t), slot) || \
+     isfrozen(hvalue(t)) ? 0 \
      : (luaC_barrierback(L, hvalue(t), v), \
         setobj2t(L, cast(TValue *,slot), v), \
         1)))
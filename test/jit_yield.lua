@@ -0,0 +1,62 @@
+-- Metamethods that yield from compiled code, at instructions that the
+-- interpreter had quickened before the function was compiled.
+-- Run with a 'make linux-jit' interpreter; without 'jit' it tests the
+-- interpreter alone.
+
+if jit then jit.on(); jit.threshold(10) end
+
+local mt = {
+  __add = function (a, b) return coroutine.yield("add") end,
+  __lt = function (a, b) return coroutine.yield("lt") end,
+}
+local a = setmetatable({}, mt)
+
+local function add (x, y) local r = x + y; return r end
+local function lt (x, y) if x < y then return "then" else return "else" end end
+
+for i = 1, 1000 do assert(add(i, 1) == i + 1 and lt(i, i + 1) == "then") end
+if jit then assert(jit.compile(add) and jit.compile(lt)) end
+
+local co = coroutine.wrap(function () return add(a, a) end)
+assert(co() == "add")
+assert(co(42) == 42)
+
+co = coroutine.wrap(function () return lt(a, a) end)
+assert(co() == "lt")
+assert(co(true) == "then")
+co = coroutine.wrap(function () return lt(a, a) end)
+assert(co() == "lt")
+assert(co(false) == "else")
+
+-- 'debug.getinfo' names the metamethod of the running instruction
+local function mul (x, y) return x * y end
+for i = 1, 1000 do assert(mul(i, 3) == 3 * i) end
+if jit then assert(jit.compile(mul)) end
+mt.__mul = function ()
+  local info = debug.getinfo(1, "n")
+  return info.namewhat .. " " .. info.name
+end
+assert(mul(a, a) == "metamethod __mul")
+
+-- instructions quickened again while a coroutine is suspended in their
+-- metamethod (by calls with numbers) must still finish as generic ones
+local function add2 (x, y) local r = x + y; return r end
+local function lt2 (x, y) if x < y then return "then" else return "else" end end
+for _, res in ipairs{true, false} do
+  local co = coroutine.create(function () return add2(a, a), lt2(a, a) end)
+  assert(select(2, coroutine.resume(co)) == "add")
+  for i = 1, 10 do assert(add2(i, 1) == i + 1) end
+  local info = debug.getinfo(co, 1, "n")
+  assert(info.namewhat == "metamethod" and info.name == "__add")
+  assert(select(2, coroutine.resume(co, 42)) == "lt")
+  for i = 1, 10 do assert(lt2(i, i + 1) == "then") end
+  info = debug.getinfo(co, 1, "n")
+  assert(info.namewhat == "metamethod" and info.name == "__lt")
+  local ok, r, c = coroutine.resume(co, res)
+  assert(ok and r == 42 and c == (res and "then" or "else"))
+end
+
+-- the quickened instructions still work after that
+for i = 1, 100 do assert(add(i, 2) == i + 2 and lt(i + 1, i) == "else") end
+
+print("JIT YIELD OK")
@@ -0,0 +1,81 @@
+-- Number-to-string conversion (tostring, '..', string.format("%s"))
+-- against 'string.format', which still goes through 'l_sprintf'.
+-- Floats must come out byte-identical to "%.14g" (plus ".0" when they
+-- look like integers); with LUA_FLOAT_SHORTEST, they must be the
+-- shortest of "%.14g" to "%.17g" that reads back as the same number.
+-- Usage: lua numconv.lua [n [seed]]
+
+local N = tonumber(arg and arg[1]) or 300000
+math.randomseed(tonumber(arg and arg[2]) or 1)
+
+local shortest = (tostring(0.1 + 0.2) ~= "0.3")
+
+local function r64 ()
+  return (math.random(0, (1 << 31) - 1) << 33) ~ (math.random(0, 1 << 31) << 2)
+         ~ math.random(0, 3)
+end
+
+local function looksint (s)
+  return s:find("^%-?%d+$") ~= nil
+end
+
+local function fltref (x)
+  local s = string.format("%.14g", x)
+  if shortest and x == x then
+    for p = 15, 17 do
+      if tonumber(s) == x then break end
+      s = string.format("%." .. p .. "g", x)
+    end
+  end
+  if looksint(s) then s = s .. ".0" end
+  return s
+end
+
+local function check (x, ref)
+  local s = tostring(x)
+  if s ~= ref or x .. "" ~= ref or string.format("%s", x) ~= ref then
+    error(string.format("%s (%a): got '%s', expected '%s'",
+                        math.type(x), x, s, ref))
+  end
+end
+
+-- special values
+for _, x in ipairs{0, math.mininteger, math.maxinteger, -1, 9, 10, 99, 100} do
+  check(x, string.format("%1d", x))
+end
+for _, x in ipairs{0.0, -0.0, 1/0, -1/0, 0/0, 2^53, 2^63, -2^63, 1e15, 1e16,
+                   0.1, 0.5, 1e-5, 1e-4, 123456789012345.0, 1e100, 1e300,
+                   2^-1074, 2^-1022, math.huge, -math.huge, math.pi} do
+  check(x, fltref(x))
+end
+
+-- decimal neighbourhoods of powers of 10, where rounding is tricky
+for e = -30, 30 do
+  for _, m in ipairs{1, 5, 9.99999999999995, 9.999999999999949, 0.5} do
+    local x = m * 10.0^e
+    check(x, fltref(x))
+    check(-x, fltref(-x))
+  end
+end
+
+for i = 1, N do
+  local k = i % 10
+  local x
+  if k == 0 then x = (math.random() - 0.5) * 10.0^math.random(-30, 40)
+  elseif k == 1 then x = string.unpack("d", string.pack("i8", r64()))
+  elseif k == 2 then x = math.random(-1e6, 1e6) / 2^math.random(0, 20)
+  elseif k == 3 then x = math.random(-1e9, 1e9) / 10^math.random(0, 9)
+  elseif k == 4 then x = r64() * (math.random(2) == 1 and -1 or 1)
+  elseif k == 5 then x = math.random(-1000, 1000)
+  elseif k == 6 then x = math.random(1, 99999) * 10.0^math.random(-20, 20)
+  elseif k == 7 then x = (math.random(1, 1e14) + 0.5) * 10.0^math.random(-16, 8)
+  elseif k == 8 then x = math.random(-1000, 1000) + 0.0
+  else x = 2.0^math.random(-1074, 1023) * (math.random(2) == 1 and -1 or 1) end
+  if math.type(x) == "integer" then
+    check(x, string.format("%1d", x))
+  elseif x == x then  -- (nan may print either sign)
+    check(x, fltref(x))
+  end
+end
+
+print("NUMCONV OK", shortest and "(shortest)" or "")
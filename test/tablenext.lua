@@ -0,0 +1,67 @@
+-- Traversals ('next'/'pairs') of tables whose keys were removed, turned
+-- into dead keys by a collection, and inserted again. Build also with
+-- -DLUA_USE_GROUPHASH, where the dead key keeps a slot that may come
+-- before the new one in the probe sequence.
+-- Usage: lua tablenext.lua [rounds [seed]]
+
+local function count (t, limit)
+  local n = 0
+  for _ in pairs(t) do
+    n = n + 1
+    assert(n <= limit, "traversal does not end")
+  end
+  return n
+end
+
+T = {}
+local keys = {}
+for i = 1, 40 do keys[i] = "key" .. i; T[keys[i]] = i end
+for trial = 1, 200 do
+  local k = keys[trial % 40 + 1]
+  T[k] = nil
+  collectgarbage()
+  T[k] = 3
+  assert(count(T, 40) == 40)
+end
+
+-- random insertions, removals, collections and traversals (which may
+-- clear fields), against a reference table
+local rounds = tonumber(arg and arg[1]) or 300
+math.randomseed(tonumber(arg and arg[2]) or 1)
+local pool = {}
+for i = 1, 200 do
+  local k = i % 4
+  pool[i] = (k == 0 and ("s" .. i)) or (k == 1 and {}) or
+            (k == 2 and i * 1.5) or i * 7
+end
+for r = 1, rounds do
+  local t, ref, n = {}, {}, 0
+  for o = 1, math.random(1, 400) do
+    local key = pool[math.random(#pool)]
+    local c = math.random(10)
+    if c <= 5 then
+      if ref[key] == nil then n = n + 1 end
+      t[key] = o; ref[key] = o
+    elseif c <= 8 then
+      if ref[key] ~= nil then n = n - 1 end
+      t[key] = nil; ref[key] = nil
+    elseif c == 9 then
+      collectgarbage()
+    else
+      local seen = 0
+      for k, v in pairs(t) do
+        assert(ref[k] == v)
+        seen = seen + 1
+        assert(seen <= n, "traversal visits a key twice")
+        if math.random(4) == 1 then  -- clearing fields is allowed
+          t[k] = nil; ref[k] = nil
+          n = n - 1; seen = seen - 1
+        end
+      end
+      assert(seen == n)
+    end
+  end
+  for k, v in pairs(ref) do assert(t[k] == v) end
+end
+
+print("TABLENEXT OK")